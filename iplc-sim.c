@@ -2,6 +2,8 @@
 /***********************************************************************/
 /***********************************************************************
  Pipeline Cache Simulator
+
+ Build: cc -O2 -o iplc-sim iplc-sim.c -lm -lpthread
  ***********************************************************************/
 /***********************************************************************/
 #include <stdio.h>
@@ -10,771 +12,7263 @@
 #include <string.h>
 #include <math.h>
 #include <assert.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <pthread.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
-#define MAX_CACHE_SIZE 10240
+#define MAX_INDEX_BITS 26    // most index bits of one cache level
+#define MAX_CACHE_LINES (1 << 26) // most lines of one cache level, 256MB of 32 bit tags
+#define ARENA_ALIGN 64      // every array of an arena starts on a host cache line
+#define HUGE_PAGE_SIZE (2UL << 20) // arenas this big or bigger ask for huge pages
 #define CACHE_MISS_DELAY 10 // 10 cycle cache miss penalty
 #define MAX_STAGES 5
+#define MAX_ASSOC 64        // the valid bits of a set are one 64 bit mask
+#define MAX_LOWER_LEVELS 2  // a shared L2 and L3 below the L1s
+#define TAG_PAD 8           // spare tags so vector compares can read past the last set
+#define RANK_PAD 0x7f       // rank of the padding ways, never younger than a real way
+#define RRIP_MAX 3          // 2 bit re-reference prediction values, 3 is distant
+#define BRRIP_LONG 32       // BRRIP inserts 1 in this many fills at RRIP_MAX - 1
+#define PREDICT_TABLE_BITS 10 // default log2 entries of each predictor table
+#define MAX_REGISTERS 32
+#define MAX_WIDTH 8         // most instructions in one superscalar pipeline group
+#define MAX_DEPTH 16        // most stages of the superscalar pipeline
 #define TRUE 1
 #define FALSE 0
 
+#define VERBOSE_QUIET 0     // the final summary only
+#define VERBOSE_CONFIG 1    // and the configuration
+#define VERBOSE_ACCESS 2    // and every cache access and its outcome
+#define VERBOSE_PIPELINE 3  // and the pipeline after every instruction, the default
+#define VERBOSE_DEBUG 4     // and every retired instruction
+
 typedef short int BIT;
 typedef unsigned int uint;
 typedef unsigned char BYTE;
 
-// init the simulator
-void iplc_sim_init(int index, int blocksize, int assoc);
+/*
+ * Every mnemonic the trace parser accepts, interned at decode time.  The
+ * binary trace format stores these values, so only ever append to the list.
+ */
+enum opcode {OP_ADD, OP_ADDI, OP_ADDIU, OP_ADDU, OP_SLL, OP_ORI, OP_LUI, OP_LW, OP_SW,
+             OP_BEQ, OP_J, OP_JAL, OP_JR, OP_SYSCALL, OP_NOP, OP_COUNT};
 
-// Cache simulator functions
-void iplc_sim_LRU_replace_on_miss(int index, int tag);
-void iplc_sim_LRU_update_on_hit(int index, int assoc);
-int iplc_sim_trap_address(unsigned int address);
+const char *opcode_names[OP_COUNT] = {"add", "addi", "addiu", "addu", "sll", "ori", "lui", "lw", "sw",
+                                      "beq", "j", "jal", "jr", "syscall", "nop"};
 
-// Pipeline functions
-unsigned int iplc_sim_parse_reg(char *reg_str);
-void iplc_sim_parse_instruction(char *buffer);
-void iplc_sim_push_pipeline_stage();
-void iplc_sim_process_pipeline_rtype(char *instruction, int dest_reg,
-                                     int reg1, int reg2_or_constant);
-void iplc_sim_process_pipeline_lw(int dest_reg, int base_reg, unsigned int data_address);
-void iplc_sim_process_pipeline_sw(int src_reg, int base_reg, unsigned int data_address);
-void iplc_sim_process_pipeline_branch(int reg1, int reg2);
-void iplc_sim_process_pipeline_jump(char *instruction);
-void iplc_sim_process_pipeline_syscall();
-void iplc_sim_process_pipeline_nop();
+/*
+ * Cache replacement policies.  LRU is the default and the only one the
+ * single pass sweep (-s) can model.
+ */
+enum replacement_policy {POLICY_LRU, POLICY_PLRU, POLICY_SRRIP, POLICY_BRRIP, POLICY_FIFO,
+                         POLICY_RANDOM, POLICY_COUNT};
 
-// Outout performance results
-void iplc_sim_finalize();
+const char *policy_names[POLICY_COUNT] = {"lru", "plru", "srrip", "brrip", "fifo", "random"};
 
-typedef struct cache_line
-{
-	BIT valid_bit;
-	uint tag;
-	struct cache_line *prev, *next;
+/*
+ * How the shared levels relate to the ones above them.  Inclusive levels
+ * back invalidate what they evict, exclusive levels only hold victims of
+ * the level above, nine (non-inclusive non-exclusive) does neither.
+ */
+enum inclusion {INCLUSION_INCLUSIVE, INCLUSION_EXCLUSIVE, INCLUSION_NINE, INCLUSION_COUNT};
 
-} cache_line_t;
+const char *inclusion_names[INCLUSION_COUNT] = {"inclusive", "exclusive", "nine"};
 
-typedef struct set
-{
-    cache_line_t *set_head, *set_tail, *data;
-} set;
+/*
+ * Branch direction predictors.  static is the original fixed taken or not
+ * taken answer from branch_predict_taken.
+ */
+enum predictor {PREDICT_STATIC, PREDICT_BIMODAL, PREDICT_GSHARE, PREDICT_TOURNAMENT, PREDICT_COUNT};
 
-set *cache=NULL;
-int cache_index=0;
-int cache_blocksize=0;
-int cache_blockoffsetbits = 0;
-int cache_assoc=0;
-long cache_miss=0;
-long cache_access=0;
-long cache_hit=0;
+const char *predictor_names[PREDICT_COUNT] = {"static", "bimodal", "gshare", "tournament"};
 
-int test = 0;
+/*
+ * Register hazards the scoreboard (-H) stalls for, by what the waiting
+ * instruction needs the register for.  An RTYPE operand is load-use when
+ * a LW produces it.
+ */
+enum hazard {HAZARD_LOAD_USE, HAZARD_ALU_USE, HAZARD_ADDRESS, HAZARD_STORE_DATA, HAZARD_BRANCH,
+             HAZARD_COUNT};
 
-char instruction[16];
-char reg1[16];
-char reg2[16];
-char offsetwithreg[16];
-unsigned int data_address=0;
-unsigned int instruction_address=0;
-unsigned int pipeline_cycles=0;   // how many cycles did you pipeline consume
-unsigned int instruction_count=0; // home many real instructions ran thru the pipeline
-unsigned int branch_predict_taken=0;
-unsigned int branch_count=0;
-unsigned int correct_branch_predictions=0;
+const char *hazard_names[HAZARD_COUNT] = {"Load-Use", "ALU Result", "Address", "Store Data",
+                                          "Branch Operand"};
 
-unsigned int debug=0;
-unsigned int dump_pipeline=1;
+/*
+ * Forwarding paths of the scoreboard: both, only EX->EX, only MEM->EX, or
+ * none so every result comes through the register file.
+ */
+enum forwarding {FORWARD_FULL, FORWARD_EX, FORWARD_MEM, FORWARD_NONE, FORWARD_COUNT};
 
-enum instruction_type {NOP, RTYPE, LW, SW, BRANCH, JUMP, JAL, SYSCALL};
+const char *forwarding_names[FORWARD_COUNT] = {"full", "ex", "mem", "none"};
+const int forward_ex[FORWARD_COUNT] = {TRUE, TRUE, FALSE, FALSE};
+const int forward_mem[FORWARD_COUNT] = {TRUE, FALSE, TRUE, FALSE};
 
-typedef struct rtype
+/*
+ * One decoded trace instruction.  LW keeps its register in dest_reg and SW
+ * keeps its source register in reg1, both keep their base register in
+ * reg2_or_constant.  BEQ compares reg1 and reg2_or_constant.
+ */
+typedef struct iplc_inst
 {
-    char instruction[16];
+    unsigned int instruction_address;
+    unsigned int data_address;
+    int op;
+    int dest_reg;
     int reg1;
     int reg2_or_constant;
-    int dest_reg;
-    
-} rtype_t;
+} iplc_inst_t;
 
-typedef struct load_word
-{
-    unsigned int data_address;
-    int dest_reg;
-    int base_reg;
-    
-} lw_t;
+#define TRACE_MAGIC "IPLCTRC2"   // first 8 bytes of a binary trace, the last is the version
+#define TRACE_VERSION 2
+#define TRACE_BUFFER_SIZE 65536
+#define TRACE_RECORD_MAX 32      // most bytes one binary record can take
 
-typedef struct store_word
+/*
+ * An open trace, either the text format or the binary format written by
+ * iplc_sim_trace_convert().
+ */
+typedef struct trace
 {
-    unsigned int data_address;
-    int src_reg;
-    int base_reg;
-} sw_t;
+    FILE *file;
+    int binary;
+    BYTE *buffer;                  // binary read buffer, or the mapped file
+    size_t pos, len;
+    char *map;                     // whole file mapped, text or binary
+    size_t map_size;
+    char *line;                    // getline() buffer when the file can't be mapped
+    size_t line_size;
+    unsigned int last_address;     // binary records are deltas against these
+    unsigned int last_data_address;
+    int version;                   // of a binary trace, 1 has no base or branch registers
+} trace_t;
 
-typedef struct branch
-{
-    int reg1;
-    int reg2;
-    
-} branch_t;
+// Trace functions
+void iplc_sim_trace_open(trace_t *trace, char *name);
+void iplc_sim_trace_memory(trace_t *trace, BYTE *data, size_t len, int version);
+int iplc_sim_trace_next(trace_t *trace, iplc_inst_t *inst);
+BYTE *iplc_sim_trace_encode(iplc_inst_t *inst, BYTE *out,
+                            unsigned int *last_address, unsigned int *last_data_address);
+void iplc_sim_trace_close(trace_t *trace);
+int iplc_sim_trace_convert(trace_t *trace, char *out_name);
+void iplc_sim_trace_put_varint(BYTE **out, uint value);
+void iplc_sim_trace_put_signed(BYTE **out, int value);
+uint iplc_sim_trace_get_varint(trace_t *trace);
+int iplc_sim_trace_get_signed(trace_t *trace);
+void iplc_sim_trace_print(FILE *out, iplc_inst_t *inst);
 
+#define GENERATE_COUNT 1000000       // default length of a generated trace
+#define GENERATE_BLOCK_MAX 256       // most instructions one loop iteration can take
+#define GENERATE_CALL_MAX 16         // deepest call chain
+#define GENERATE_CODE 0x00400000
+#define GENERATE_DATA 0x10010000
+#define GENERATE_STACK 0x7fffeff0
+#define GENERATE_ARRAY_SIZE 1048576  // bytes sequential and stride walk before starting over
+#define GENERATE_NODE_SIZE 64        // bytes per pointer chasing node
+#define GENERATE_FUNCTION_SIZE 0x100 // code bytes per call depth
+#define GENERATE_TRIPS 16            // iterations of the tight loop per outer iteration
 
-typedef struct jump
-{
-    char instruction[16];
-    
-} jump_t;
+/*
+ * Synthetic trace patterns for -G and the benchmark.
+ */
+enum pattern {PATTERN_SEQUENTIAL, PATTERN_STRIDE, PATTERN_RANDOM, PATTERN_CHASE, PATTERN_LOOP,
+              PATTERN_CALL, PATTERN_COUNT};
 
-typedef struct pipeline
+const char *pattern_names[PATTERN_COUNT] = {"sequential", "stride", "random", "chase", "loop", "call"};
+
+/*
+ * A synthetic trace in progress.  Each pattern is a loop, one iteration is
+ * generated into block at a time and handed out from there.
+ */
+typedef struct generator
 {
-    enum instruction_type itype;
-    unsigned int instruction_address;
-    union
-    {
-        rtype_t   rtype;
-        lw_t      lw;
-        sw_t      sw;
-        branch_t  branch;
-        jump_t    jump;
-    }
-    stage;
-    
-} pipeline_t;
+    int pattern;
+    unsigned long remaining;
+    unsigned int param;
+    uint64_t random_state;
+    unsigned int cursor;           // data offset, node or trip count, depending on the pattern
+    unsigned int *chain;           // chase: the node after each node
+    unsigned int nodes;
+    iplc_inst_t block[GENERATE_BLOCK_MAX];
+    int block_len, block_pos;
+} generator_t;
 
-enum pipeline_stages {FETCH, DECODE, ALU, MEM, WRITEBACK};
+// Synthetic traces
+int iplc_sim_parse_pattern(char *name);
+void iplc_sim_generate_init(generator_t *gen, int pattern, unsigned long count,
+                            unsigned int param, uint64_t seed);
+void iplc_sim_generate_free(generator_t *gen);
+int iplc_sim_generate_next(generator_t *gen, iplc_inst_t *inst);
+void iplc_sim_generate_trace(char *spec, char *out_name);
 
-pipeline_t pipeline[MAX_STAGES];
+#define EVENT_MAGIC "IPLCEVT1"   // first 8 bytes of an event log
+#define EVENT_BUFFER_SIZE 65536
+#define EVENT_RECORD_MAX 16      // most bytes one event record can take
 
-/************************************************************************************************/
-/* Cache Functions ******************************************************************************/
-/************************************************************************************************/
 /*
- * Correctly configure the cache.
+ * What the simulator can log instead of printing.  The log stores these
+ * values, so only ever append to the list.
  */
+enum event_kind {EVENT_FETCH_HIT, EVENT_FETCH_MISS, EVENT_LOAD_HIT, EVENT_LOAD_MISS, EVENT_STORE_HIT,
+                 EVENT_STORE_MISS, EVENT_BRANCH_CORRECT, EVENT_BRANCH_MISPREDICT, EVENT_RETIRE,
+                 EVENT_COUNT};
 
+const char *event_names[EVENT_COUNT] = {"fetch-hit", "fetch-miss", "load-hit", "load-miss", "store-hit",
+                                        "store-miss", "branch-correct", "branch-mispredict", "retire"};
 
-void iplc_sim_init(int index, int blocksize, int assoc)
+/*
+ * A binary event log being written.  Records are buffered and written a
+ * buffer at a time.
+ */
+typedef struct event_log
 {
-    int i=0, j=0;
-    unsigned long cache_size = 0;
-    cache_index = index;
-    cache_blocksize = blocksize;
-    cache_assoc = assoc;
-    
-    
-    cache_blockoffsetbits =
-    (int) rint((log( (double) (blocksize * 4) )/ log(2)));
-    /* Note: rint function rounds the result up prior to casting */
-    
-    cache_size = assoc * ( 1 << index ) * ((32 * blocksize) + 33 - index - cache_blockoffsetbits);
-    
-    printf("Cache Configuration \n");
-    printf("   Index: %d bits or %d lines \n", cache_index, (1<<cache_index) );
-    printf("   BlockSize: %d \n", cache_blocksize );
-    printf("   Associativity: %d \n", cache_assoc );
-    printf("   BlockOffSetBits: %d \n", cache_blockoffsetbits );
-    printf("   CacheSize: %lu \n", cache_size );
-    
-    if (cache_size > MAX_CACHE_SIZE ) {
-        printf("Cache too big. Great than MAX SIZE of %d .... \n", MAX_CACHE_SIZE);
-        exit(-1);
-    }
-    
-    int total_lines = (1 << index);
+    FILE *file;
+    BYTE buffer[EVENT_BUFFER_SIZE];
+    size_t len;
+    unsigned int last_cycle;       // records are deltas against these
+    unsigned int last_pc;
+    unsigned int last_address;
+    long count;
+} event_log_t;
 
-    cache = (set*) malloc(sizeof(set) * total_lines);    
-	// // Dynamically create our cache based on the information the user entered
-    for (i = 0; i < total_lines; i++){
-        cache[i].data = (cache_line_t*) malloc(sizeof(cache_line_t) * cache_assoc);
-        cache[i].set_head = &cache[i].data[0]; //Set each sets head = to the first line in data
-        cache[i].set_tail = cache[i].set_head;
-        for (j = 0; j < cache_assoc; j++){
-            cache[i].data[j].tag = cache[i].data[j].valid_bit = 0;
-            //NULL the next and prev pointers for each line in set
-            cache[i].data[j].next = NULL;
-            cache[i].data[j].prev = NULL;
-        }
-    }
+// Event log functions
+event_log_t *iplc_sim_event_open(char *name);
+void iplc_sim_event_record(event_log_t *log, int kind, unsigned int cycle,
+                           unsigned int pc, unsigned int address);
+void iplc_sim_event_close(event_log_t *log);
+long iplc_sim_event_decode(char *name);
 
-    // init the pipeline -- set all data to zero and instructions to NOP
-    for (i = 0; i < MAX_STAGES; i++) {
-        // itype is set to O which is NOP type instruction
-        bzero(&(pipeline[i]), sizeof(pipeline_t));
-    }
-}
+typedef struct iplc_sim iplc_sim_t;
+typedef struct multicore multicore_t;
+typedef struct cache cache_t;
+
+#define SHADOW_EMPTY -2     // hash slot not in use
+#define SHADOW_OUT -1       // block seen before, but not in the shadow cache
+#define SHADOW_MIN_BITS 10  // log2 of the seen set's starting size
 
 /*
- * iplc_sim_trap_address() determined this is not in our cache.  Put it there
- * and make sure that is now our Most Recently Used (MRU) entry.
+ * A fully associative LRU cache with as many blocks as the real one, to
+ * tell capacity from conflict misses.  The open addressing hash maps every
+ * block address the cache was ever asked for to its node, so it is also
+ * the seen set for compulsory misses.  The resident blocks are a doubly
+ * linked list through nodes, MRU first, so an access is O(1).
  */
-void iplc_sim_LRU_replace_on_miss(int index, int tag)
+typedef struct shadow_slot
 {
-    /* You must implement this function */
-    //Check if there is an empty space in set
-    set *target_set = &cache[index];
-    cache_line_t *ptr = NULL;
-    int empty_index = 0;
+    uint block;                     // address >> blockoffsetbits
+    int node;                       // index into nodes, or SHADOW_EMPTY / SHADOW_OUT
+} shadow_slot_t;
 
-    BIT is_space = FALSE;
+typedef struct shadow_node
+{
+    uint block;
+    int prev, next;                 // toward MRU and LRU, -1 past the ends
+} shadow_node_t;
 
-    for (int i = 0; i < cache_assoc; i++){
-        if (target_set->data[i].valid_bit == 0){
-            is_space = TRUE;
-            break;
-        }
-        empty_index++;
-    }
+typedef struct shadow
+{
+    shadow_slot_t *slots;
+    uint mask;                      // slot count - 1, a power of two
+    int shift;                      // 32 - log2 slot count
+    uint used;
+    shadow_node_t *nodes;           // capacity of them
+    int capacity;
+    int resident;
+    int head, tail;                 // MRU and LRU node, -1 when empty
+} shadow_t;
 
-    //If there is no more space in set
-    if (!is_space){
-        ptr = target_set->set_tail;
-        if (ptr->next){
-            target_set->set_tail = ptr->next;
-            target_set->set_tail->prev = NULL; 
-        }
-    }
-    //Else empty space at "empty_space"
-    else{
-        ptr = &target_set->data[empty_index];
-    }
+/*
+ * Hardware prefetchers of an L1.  nextline fetches the degree blocks after
+ * a miss (and after the first use of a prefetched block, so a stream keeps
+ * going), stride follows each LW/SW's own stride once it has repeated, and
+ * stream keeps the blocks after a miss in stream buffers beside the cache
+ * instead of in it.
+ */
+enum prefetcher {PREFETCH_NONE, PREFETCH_NEXTLINE, PREFETCH_STRIDE, PREFETCH_STREAM, PREFETCH_COUNT};
 
-    //Set valid bit = 1 and tag
-    ptr->valid_bit = 1;
-    ptr->tag = tag;
+const char *prefetcher_names[PREFETCH_COUNT] = {"none", "nextline", "stride", "stream"};
 
-    if (ptr != target_set->set_head){
-        target_set->set_head->next = ptr;
-        ptr->prev = target_set->set_head;
-        ptr->next = NULL;
-        target_set->set_head = ptr;
-    }
-   
-}
+#define PREFETCH_DEGREE 2       // blocks fetched ahead when -r gives no degree
+#define PREFETCH_DEGREE_MAX 16
+#define PREFETCH_STRIDE_BITS 6  // log2 entries of the PC indexed stride table
+#define PREFETCH_STREAMS 4      // stream buffers per L1
+#define PREFETCH_FILTER_BITS 10 // log2 entries of the pollution filter
 
 /*
- * iplc_sim_trap_address() determined the entry is in our cache.  Update its
- * information in the cache.
+ * One stride table entry: the last address a LW/SW used, the stride it
+ * moved by and a 2 bit confidence that the stride repeats.
  */
-void iplc_sim_LRU_update_on_hit(int index, int assoc_entry)
+typedef struct prefetch_stride
 {
-    //Assoc_entry is entry index within cache[index] set that hit
+    uint pc;
+    uint last;
+    int stride;
+    int confidence;
+} prefetch_stride_t;
 
-    //Find the set that hit belongs to
-    set* set_hit = &cache[index];
-    cache_line_t* head = set_hit->set_head;
-    //Now find the entry within the set that hit
-    cache_line_t* entry_hit = &set_hit->data[assoc_entry];
+/*
+ * One stream buffer, the count blocks from first on, each with the cycle
+ * its fetch is done.  ready is a ring starting at head.
+ */
+typedef struct prefetch_stream
+{
+    uint first;
+    int count;
+    int head;
+    unsigned int ready[PREFETCH_DEGREE_MAX];
+    unsigned long last_use;         // of the buffers, the oldest is reused
+} prefetch_stream_t;
 
-    //If already MRU do nothing..
-    if (entry_hit == head){
-        return;
-    }
-    //If assoc > 1 & in the body of set (not head)
-    else if (entry_hit->next){
-        entry_hit->next->prev = entry_hit->next;
-        if (entry_hit->prev){
-            entry_hit->prev->next = entry_hit->next;
-        }
-        //We are @ the tail
-        else{
-            set_hit->set_tail = entry_hit->next;
-            set_hit->set_tail->prev = NULL;
-        }
-        //New head
-        set_hit->set_head->next = entry_hit;
-        entry_hit->prev = set_hit->set_head;
-        entry_hit->next = NULL;
-        set_hit->set_head = entry_hit;
-    }
+/*
+ * The prefetcher of one L1.  prefetched marks the ways filled by a
+ * prefetch and not used yet, ready has the cycle each way's fill is done.
+ * The pollution filter remembers the blocks prefetch fills threw out, a
+ * demand miss on one of them is a miss the prefetcher caused.
+ */
+typedef struct prefetch
+{
+    int kind;
+    int degree;
+    int latency;                    // cycles a prefetch takes, 0 for the latency of the level it came from
+    uint64_t *prefetched;           // one bit per way, per set
+    unsigned int *ready;            // (1 << index) * assoc cycles
+    prefetch_stride_t stride[1 << PREFETCH_STRIDE_BITS];
+    prefetch_stream_t streams[PREFETCH_STREAMS];
+    unsigned long stream_uses;
+    uint filter[1 << PREFETCH_FILTER_BITS]; // block + 1, 0 is empty
+    long issued;
+    long useful;                    // prefetched blocks a demand access used
+    long late;                      // and had to wait for
+    unsigned long late_cycles;
+    long useless;                   // prefetched blocks dropped unused
+    long pollution;
+    long uncovered;                 // demand misses no prefetch covered
+} prefetch_t;
 
-}
+/*
+ * TLBs, each a cache level whose blocks are pages: the ITLB and DTLB
+ * beside the L1s and a shared L2 TLB behind them.  A miss in both walks a
+ * radix page table of 9 bit levels like x86-64's, four for 4K pages and
+ * three for 2M pages, whose entries are 8 bytes from PAGE_TABLE_BASE on.
+ */
+enum tlb {TLB_I, TLB_D, TLB_L2, TLB_COUNT};
+
+#define PAGE_4K_BITS 12
+#define PAGE_2M_BITS 21
+#define PAGE_LEVEL_BITS 9           // virtual page number bits each page table level resolves
+#define PAGE_TABLE_BASE 0xc0000000u // where the tables of the first level are
+#define PAGE_TABLE_SPAN 0x01000000u // bytes set aside for the tables of each level
+#define TLB_L2_LATENCY 7            // cycles an L2 TLB hit adds when -L gives none
 
 /*
- * Check if the address is in our cache.  Update our counter statistics 
- * for cache_access, cache_hit, etc.  If our configuration supports
- * associativity we may need to check through multiple entries for our
- * desired index.  In that case we will also need to call the LRU functions.
+ * The running totals an interval row is the difference of.
  */
-int iplc_sim_trap_address(unsigned int address)
+typedef struct interval_stats
 {
-	int i = 0, index = 0;
-	int tag = 0;
-    int hit = 0;
-    
-	 //Cache is accessed
-	uint other_bits = cache_blockoffsetbits + cache_index;
-	uint bit_mask = ((1 << cache_index) - 1) << cache_blockoffsetbits;
+    unsigned int instructions;
+    unsigned int cycles;
+    long fetch_accesses;
+    long fetch_misses;
+    long data_accesses;
+    long data_misses;
+    unsigned int correct_branches;
+    unsigned int mispredicted_branches;
+    unsigned long stall_fetch;
+    unsigned long stall_data;
+    unsigned long stall_branch;
+    unsigned long stall_load_use;
+} interval_stats_t;
 
-	tag = address >> other_bits;
-	index = (bit_mask & address) >> cache_blockoffsetbits; 
-  
-    printf("Address %x: Tag= %x, Index= %d \n", address, tag, index);
+// init the simulator
+int iplc_sim_init(iplc_sim_t *sim, int index, int blocksize, int assoc);
+void iplc_sim_free(iplc_sim_t *sim);
 
-	cache_access++;
-    for (i = 0; i < cache_assoc; i++){
-        //If the valid bit is one for an entry in the set and teh tag matches then 
-        //we hit
-        if((cache[index].data[i].tag == tag) && (cache[index].data[i].valid_bit)){
-            cache_hit++;
-            hit = 1;
-            iplc_sim_LRU_update_on_hit(index, i);
-            return hit;
-        }
-    }
-    //IF we went through the set but didnt find a match then it must be a miss
-    cache_miss++;
-    iplc_sim_LRU_replace_on_miss(index, tag);
+// Cache simulator functions
+int iplc_sim_parse_policy(char *name);
+int iplc_sim_cache_geometry(int index, int blocksize, int verbose);
+int iplc_sim_cache_init(cache_t *cache, const char *name, int index, int blocksize, int assoc,
+                        int policy, int latency, int dirty, int verbose);
+void *iplc_sim_arena_map(size_t *size);
+void iplc_sim_cache_free(cache_t *cache);
+int iplc_sim_cache_access(cache_t *cache, unsigned int address);
+int iplc_sim_cache_extract(cache_t *cache, unsigned int address);
+void iplc_sim_cache_insert(cache_t *cache, unsigned int address);
+int iplc_sim_cache_invalidate(cache_t *cache, unsigned int address);
+int iplc_sim_back_invalidate(iplc_sim_t *sim, int level, unsigned int address);
+void iplc_sim_cache_mark_dirty(cache_t *cache, unsigned int address);
+int iplc_sim_cache_probe(cache_t *cache, unsigned int address);
+void iplc_sim_write_below(iplc_sim_t *sim, int level, unsigned int address);
+int iplc_sim_write_buffer_merge(iplc_sim_t *sim, unsigned int block);
+int iplc_sim_write_buffer_put(iplc_sim_t *sim, unsigned int block, int latency);
+int iplc_sim_store(iplc_sim_t *sim, unsigned int address, int buffered, int *cycles);
+int iplc_sim_lower_walk(iplc_sim_t *sim, unsigned int address);
+void iplc_sim_evict_below(iplc_sim_t *sim, cache_t *cache, int dirty, unsigned int victim);
+int iplc_sim_trap_address(iplc_sim_t *sim, cache_t *cache, unsigned int address, int *cycles);
+void iplc_sim_cache_report(iplc_sim_t *sim, cache_t *cache);
+void iplc_sim_shadow_init(cache_t *cache);
+void iplc_sim_shadow_free(cache_t *cache);
+void iplc_sim_shadow_access(cache_t *cache, unsigned int address, int hit);
 
-	return hit;
-}
+// Prefetcher functions
+int iplc_sim_parse_prefetcher(char *name);
+void iplc_sim_prefetch_init(iplc_sim_t *sim, cache_t *cache);
+void iplc_sim_prefetch_free(cache_t *cache);
+void iplc_sim_prefetch_fill(iplc_sim_t *sim, cache_t *cache, unsigned int address);
+int iplc_sim_prefetch_hit(iplc_sim_t *sim, cache_t *cache, unsigned int address, int *cycles);
+int iplc_sim_prefetch_miss(iplc_sim_t *sim, cache_t *cache, unsigned int address, int *cycles);
+void iplc_sim_prefetch_trigger(iplc_sim_t *sim, cache_t *cache, unsigned int address, int trigger);
+
+// TLB functions
+int iplc_sim_tlb_init(iplc_sim_t *sim);
+void iplc_sim_tlb_free(iplc_sim_t *sim);
+unsigned int iplc_sim_pte_address(iplc_sim_t *sim, unsigned int address, int level);
+int iplc_sim_page_walk(iplc_sim_t *sim, unsigned int address);
+int iplc_sim_translate(iplc_sim_t *sim, int kind, unsigned int address);
+void iplc_sim_tlb_report(iplc_sim_t *sim);
+
+// Branch prediction functions
+int iplc_sim_parse_predictor(char *name);
+int iplc_sim_predictor_init(iplc_sim_t *sim);
+void iplc_sim_predictor_free(iplc_sim_t *sim);
+int iplc_sim_predict(iplc_sim_t *sim, unsigned int address);
+void iplc_sim_predictor_update(iplc_sim_t *sim, unsigned int address, int taken);
+int iplc_sim_btb_lookup(iplc_sim_t *sim, unsigned int address, unsigned int *target);
+void iplc_sim_btb_update(iplc_sim_t *sim, unsigned int address, unsigned int target);
+int iplc_sim_branch_resolve(iplc_sim_t *sim, unsigned int address, unsigned int next_address);
+
+// Interval statistics
+void iplc_sim_interval_init(iplc_sim_t *sim);
+void iplc_sim_interval_snapshot(iplc_sim_t *sim, interval_stats_t *stats);
+void iplc_sim_interval_emit(iplc_sim_t *sim);
+void iplc_sim_interval_finish(iplc_sim_t *sim);
+
+// Sampled simulation
+void iplc_sim_functional_instruction(iplc_sim_t *sim, iplc_inst_t *inst);
+int iplc_sim_sample_step(iplc_sim_t *sim);
+double iplc_sim_sample_cpi(iplc_sim_t *sim, double *half_width);
+void iplc_sim_sample_report(iplc_sim_t *sim);
+
+#define PROFILE_MIN_BITS 10     // log2 of each profile table's starting size
 
 /*
- * Just output our summary statistics.
+ * One instruction address (or L1D block) of the profile.  For a block,
+ * executions counts its accesses and last_miss is the PC of its latest
+ * miss.
  */
-void iplc_sim_finalize()
+typedef struct profile_entry
 {
-    /* Finish processing all instructions in the Pipeline */
-    while (pipeline[FETCH].itype != NOP  ||
-           pipeline[DECODE].itype != NOP ||
-           pipeline[ALU].itype != NOP    ||
-           pipeline[MEM].itype != NOP    ||
-           pipeline[WRITEBACK].itype != NOP) {
-        iplc_sim_push_pipeline_stage();
-    }
-    
-    printf(" Cache Performance \n");
-    printf("\t Number of Cache Accesses is %ld \n", cache_access);
-    printf("\t Number of Cache Misses is %ld \n", cache_miss);
-    printf("\t Number of Cache Hits is %ld \n", cache_hit);
-    printf("\t Cache Miss Rate is %f \n\n", (double)cache_miss / (double)cache_access);
-    printf("Pipeline Performance \n");
-    printf("\t Total Cycles is %u \n", pipeline_cycles);
-    printf("\t Total Instructions is %u \n", instruction_count);
-    printf("\t Total Branch Instructions is %u \n", branch_count);
-    printf("\t Total Correct Branch Predictions is %u \n", correct_branch_predictions);
-    printf("\t CPI is %f \n\n", (double)pipeline_cycles / (double)instruction_count);
-}
+    uint address;                   // PC or block number + 1, 0 is an empty slot
+    uint executions;
+    uint fetch_misses;
+    uint data_misses;
+    uint mispredictions;
+    uint last_miss;                 // data address of this PC's latest L1D miss
+    unsigned long stall_cycles;
+} profile_entry_t;
 
-/************************************************************************************************/
-/* Pipeline Functions ***************************************************************************/
-/************************************************************************************************/
+/*
+ * Open addressing on address + 1, grown at half full.
+ */
+typedef struct profile_table
+{
+    profile_entry_t *slots;
+    uint mask;                      // slot count - 1, a power of two
+    int shift;                      // 32 - log2 slot count
+    long count;
+} profile_table_t;
 
 /*
- * Dump the current contents of our pipeline.
+ * The per PC profile (-A).  Every stall cycle is charged to the
+ * instruction that waited for it: a fetch miss to the instruction being
+ * fetched, a slow data access to its LW/SW, a RAW hazard or a missed load
+ * to the instruction that needed the register, and a misprediction to its
+ * branch.
  */
-void iplc_sim_dump_pipeline()
+typedef struct profile
 {
-    int i;    
-    for (i = 0; i < MAX_STAGES; i++) {
-        switch(i) {
-            case FETCH:
-                printf("(cyc: %u) FETCH:\t %d: 0x%x \t", pipeline_cycles, pipeline[i].itype, pipeline[i].instruction_address);
-                break;
-            case DECODE:
-                printf("DECODE:\t %d: 0x%x \t", pipeline[i].itype, pipeline[i].instruction_address);
-                break;
-            case ALU:
-                printf("ALU:\t %d: 0x%x \t", pipeline[i].itype, pipeline[i].instruction_address);
-                break;
-            case MEM:
-                printf("MEM:\t %d: 0x%x \t", pipeline[i].itype, pipeline[i].instruction_address);
-                break;
-            case WRITEBACK:
-                printf("WB:\t %d: 0x%x \n", pipeline[i].itype, pipeline[i].instruction_address);
-                break;
-            default:
-                printf("DUMP: Bad stage!\n" );
-                exit(-1);
-        }
-    }
-}
+    profile_table_t pcs;
+    profile_table_t blocks;         // the L1D misses by data block
+    int block_bits;                 // blockoffsetbits of the L1D
+    int top;                        // hotspots in the report
+    FILE *file;                     // flat file of every PC, or NULL
+} profile_t;
+
+// Profile functions
+profile_t *iplc_sim_profile_open(int top, char *name, int block_bits);
+profile_entry_t *iplc_sim_profile_entry(profile_table_t *table, uint address);
+int iplc_sim_profile_compare(const void *a, const void *b);
+int iplc_sim_profile_address_compare(const void *a, const void *b);
+profile_entry_t *iplc_sim_profile_sorted(profile_table_t *table,
+                                         int (*compare)(const void*, const void*));
+void iplc_sim_profile_report(profile_t *profile);
+void iplc_sim_profile_close(profile_t *profile);
+
+#define CHECKPOINT_MAGIC "IPLCCKP1"  // first 8 bytes of a checkpoint, the last is the version
 
 /*
- * Check if various stages of our pipeline require stalls, forwarding, etc.
- * Then push the contents of our various pipeline stages through the pipeline.
+ * What follows the magic number of a checkpoint: where the trace was, so
+ * a restore can go on from the next instruction.  Then comes the whole
+ * iplc_sim_t and the arrays it points to.
  */
-void iplc_sim_push_pipeline_stage()
+typedef struct checkpoint_header
 {
-	int data_hit = 1;
-	int normalProcessing = TRUE;
-	/* 1. Count WRITEBACK stage is "retired" -- This I'm giving you */
-	if (pipeline[WRITEBACK].instruction_address) {
-		instruction_count++;
-		if (debug)
-			printf("DEBUG: Retired Instruction at 0x%x, Type %d, at Time %u \n",
-				pipeline[WRITEBACK].instruction_address, pipeline[WRITEBACK].itype, pipeline_cycles);
-	}
+    uint sim_size;                  // sizeof(iplc_sim_t) of the simulator that wrote it
+    int trace_binary;
+    unsigned long records;          // trace instructions run
+    unsigned long trace_size;       // of the mapped trace, 0 if it was read through stdio
+    unsigned long trace_pos;        // offset of the next record in the mapped trace
+    uint last_address;              // binary trace delta state
+    uint last_data_address;
+} checkpoint_header_t;
 
-	/* 2. Check for BRANCH and correct/incorrect Branch Prediction */
-    if (pipeline[DECODE].itype == BRANCH) {
-		int branch_taken = FALSE;
-		branch_count++;
-		//assuming that the instructions are in order, the next instruction will just be the one in the fetch stage
-        if ((pipeline[DECODE].instruction_address + 4) != pipeline[FETCH].instruction_address) {
-            //branch was taken
-			branch_taken = TRUE;
-        }
-		if (branch_taken == branch_predict_taken) {
-            if(pipeline[FETCH].itype != NOP) { //if the next instruction is a NOP then don't update correct branch predictions
-                correct_branch_predictions++;
-            }
-		}
-        else { //prediction was wrong and a NOP needs to be inserted
-            if(pipeline[FETCH].itype!=NOP) {                
-			    pipeline_cycles+=2; //extra stall cycle. adds 2 because of the 1 additional stall and 1 normal processing
-			    normalProcessing = FALSE;
-            }
-        }
-	}
+// Checkpoint functions
+void iplc_sim_checkpoint_io(FILE *file, void *data, size_t size, int save);
+void iplc_sim_checkpoint_cache(FILE *file, cache_t *cache, cache_t *kept, int save);
+void iplc_sim_checkpoint_arrays(FILE *file, iplc_sim_t *sim, iplc_sim_t *kept, int save);
+void iplc_sim_checkpoint_save(iplc_sim_t *sim, char *name, trace_t *trace, unsigned long records);
+const char *iplc_sim_checkpoint_mismatch(iplc_sim_t *sim, iplc_sim_t *saved);
+unsigned long iplc_sim_checkpoint_restore(iplc_sim_t *sim, char *name, trace_t *trace);
 
-	/* 3. Check for LW delays due to use in ALU stage and if data hit/miss
-	 *    add delay cycles if needed.
-	 */
-	if (pipeline[MEM].itype == LW) {
-		//check for data miss
-		data_hit = iplc_sim_trap_address(pipeline[MEM].stage.lw.data_address);
-        if (!data_hit) { //not found in cache, need to add stall
-            printf("DATA MISS: ADDRESS 0x%x\n", pipeline[MEM].stage.lw.data_address);
-			pipeline_cycles += 10; //10 stall cycles for a data hazard
-			normalProcessing = FALSE;
-        }
-        else {
-            printf("DATA HIT: ADDRESS 0x%x\n", pipeline[MEM].stage.lw.data_address);
-        }
-        //need to check for the ALU delays
-        if (pipeline[ALU].itype==LW) {
-            if (pipeline[MEM].stage.lw.dest_reg == pipeline[ALU].stage.lw.dest_reg) {
-                pipeline_cycles+=1; //need to stall for a cycle
-            }
-        }
-        if (pipeline[ALU].itype==SW) {
-            if (pipeline[MEM].stage.lw.dest_reg == pipeline[ALU].stage.sw.src_reg) {
-                pipeline_cycles+=1; //need to stall for a cycle
-            }
-        }
-    }
-	/* 4. Check for SW mem acess and data miss .. add delay cycles if needed */
-	if (pipeline[MEM].itype == SW) {
-		data_hit = iplc_sim_trap_address(pipeline[MEM].stage.sw.data_address);
-        if (!data_hit) { //not found in cache, need to add stall
-            printf("DATA MISS: ADDRESS 0x%x\n", pipeline[MEM].stage.sw.data_address);
-			pipeline_cycles += 10;
-			normalProcessing = FALSE;
-        }
-        else {
-            printf("DATA HIT: ADDRESS 0x%x\n", pipeline[MEM].stage.sw.data_address);            
-        }
-	}
+// Pipeline functions
+void iplc_sim_opcode_keys_init();
+void iplc_sim_decode_line(const char *p, const char *end, iplc_inst_t *inst);
+void iplc_sim_parse_instruction(iplc_sim_t *sim, char *buffer);
+void iplc_sim_process_instruction(iplc_sim_t *sim, iplc_inst_t *inst);
+void iplc_sim_push_pipeline_stage(iplc_sim_t *sim);
+int iplc_sim_mshr_find(iplc_sim_t *sim, unsigned int block);
+void iplc_sim_stall_pipeline(iplc_sim_t *sim, unsigned int pushes);
+int iplc_sim_group_empty(iplc_sim_t *sim);
+void iplc_sim_push_group(iplc_sim_t *sim);
+void iplc_sim_issue_group(iplc_sim_t *sim, iplc_inst_t *inst);
+void iplc_sim_process_pipeline_rtype(iplc_sim_t *sim, int op, int dest_reg,
+                                     int reg1, int reg2_or_constant);
+void iplc_sim_process_pipeline_lw(iplc_sim_t *sim, int dest_reg, int base_reg, unsigned int data_address);
+void iplc_sim_process_pipeline_sw(iplc_sim_t *sim, int src_reg, int base_reg, unsigned int data_address);
+void iplc_sim_process_pipeline_branch(iplc_sim_t *sim, int reg1, int reg2);
+void iplc_sim_process_pipeline_jump(iplc_sim_t *sim, int op);
+void iplc_sim_process_pipeline_syscall(iplc_sim_t *sim);
+void iplc_sim_process_pipeline_nop(iplc_sim_t *sim);
 
-	/* 5. Increment pipe_cycles 1 cycle for normal processing */
-	if (normalProcessing) {
-		pipeline_cycles++; //if normalProcessing is false than the pipeline cycles have already been added
-	}
+// Outout performance results
+void iplc_sim_drain(iplc_sim_t *sim);
+void iplc_sim_finalize(iplc_sim_t *sim);
 
-	/* 6. push stages thru MEM->WB, ALU->MEM, DECODE->ALU, FETCH->DECODE */
-	//MEM-WB
-	pipeline[WRITEBACK] = pipeline[MEM];
-    //ALU->MEM
-    pipeline[MEM] = pipeline[ALU];
-	//Decode->ALU
-    pipeline[ALU]=pipeline[DECODE];
-    //FETCH->DECODE
-    pipeline[DECODE] = pipeline[FETCH];
-    
-    // 7. This is a give'me -- Reset the FETCH stage to NOP via bezero */
-    bzero(&(pipeline[FETCH]), sizeof(pipeline_t));
-}
+enum instruction_type {NOP, RTYPE, LW, SW, BRANCH, JUMP, JAL, SYSCALL};
 
 /*
- * This function is fully implemented.  You should use this as a reference
- * for implementing the remaining instruction types.
+ * One pipeline stage.  The mnemonic is kept as its enum opcode, and the
+ * registers as shorts, so a stage is 16 bytes.  The registers are kept
+ * where iplc_inst_t keeps them.
  */
-void iplc_sim_process_pipeline_rtype(char *instruction, int dest_reg, int reg1, int reg2_or_constant)
+typedef struct pipeline
 {
-    /* This is an example of what you need to do for the rest */
-    iplc_sim_push_pipeline_stage();
-    
-    pipeline[FETCH].itype = RTYPE;
-    pipeline[FETCH].instruction_address = instruction_address;
-    
-    strcpy(pipeline[FETCH].stage.rtype.instruction, instruction);
-    pipeline[FETCH].stage.rtype.reg1 = reg1;
-    pipeline[FETCH].stage.rtype.reg2_or_constant = reg2_or_constant;
-    pipeline[FETCH].stage.rtype.dest_reg = dest_reg;
-}
+    unsigned int instruction_address;
+    unsigned int data_address;      // LW and SW
+    short dest_reg;
+    short reg1;
+    short reg2_or_constant;
+    BYTE itype;                     // enum instruction_type, 0 is NOP
+    BYTE op;                        // enum opcode
+} pipeline_t;
 
-void iplc_sim_process_pipeline_lw(int dest_reg, int base_reg, unsigned int data_address)
-{
-    /* You must implement this function */
-	iplc_sim_push_pipeline_stage(); //pushing the pipeline along
-    
-    //setting the pipeline fetch stage to the appropriate values
-	pipeline[FETCH].itype = LW;
-	pipeline[FETCH].instruction_address = instruction_address;
+enum pipeline_stages {FETCH, DECODE, ALU, MEM, WRITEBACK};
 
-    //setting the registers
-	pipeline[FETCH].stage.lw.dest_reg = dest_reg;
-	pipeline[FETCH].stage.lw.base_reg = base_reg;
-	pipeline[FETCH].stage.lw.data_address = data_address;
-}
+// the instruction_type of each opcode
+const BYTE opcode_itypes[OP_COUNT] = {RTYPE, RTYPE, RTYPE, RTYPE, RTYPE, RTYPE, RTYPE, LW, SW,
+                                      BRANCH, JUMP, JUMP, JUMP, SYSCALL, NOP};
 
-void iplc_sim_process_pipeline_sw(int src_reg, int base_reg, unsigned int data_address)
+/*
+ * One stage of the superscalar pipeline (-N): up to issue_width
+ * instructions in program order, none of which reads a register an older
+ * one in the group writes.  A branch or jump is always the last of its
+ * group.
+ */
+typedef struct pipeline_group
 {
-    /* You must implement this function */
-	iplc_sim_push_pipeline_stage(); //pushing the pipeline along
-    
-    //setting the pipeline fetch stage to the appropriate values
-	pipeline[FETCH].itype = SW;
-	pipeline[FETCH].instruction_address = instruction_address;
+    pipeline_t slot[MAX_WIDTH];
+    BYTE count;
+    BYTE memory_ops;                // LW/SW, each takes a memory port
+    BYTE alu_ops;                   // RTYPE, each takes an ALU
+    BYTE closed;                    // ended by a branch or jump
+} pipeline_group_t;
 
-    //setting the registers
-	pipeline[FETCH].stage.sw.src_reg = src_reg;
-	pipeline[FETCH].stage.sw.base_reg = base_reg;
-	pipeline[FETCH].stage.sw.data_address = data_address;
-}
+/*
+ * Why a fetch group took no more instructions.
+ */
+enum group_end {GROUP_WIDTH, GROUP_PORTS, GROUP_ALUS, GROUP_DEPENDENCY, GROUP_CONTROL, GROUP_FETCH,
+                GROUP_END_COUNT};
 
-void iplc_sim_process_pipeline_branch(int reg1, int reg2)
-{
-    /* You must implement this function */
-	iplc_sim_push_pipeline_stage();  //pushing the pipeline along
-    
-    //setting the pipeline fetch stage to the appropriate values
-	pipeline[FETCH].itype = BRANCH;
-	pipeline[FETCH].instruction_address = instruction_address;
+const char *group_end_names[GROUP_END_COUNT] = {"Width", "Memory Port", "ALU", "Dependency",
+                                                "Branch or Jump", "Fetch Stall"};
 
-    //setting the registers
-	pipeline[FETCH].stage.branch.reg1 = reg1;
-	pipeline[FETCH].stage.branch.reg2 = reg2;
-}
+/*
+ * One level of the cache hierarchy.  The cache is stored as arrays rather
+ * than per-set line structs, all of them in one mapped arena.  The ways of
+ * a set are adjacent in tags, so one vector compare checks several ways at
+ * once.  When the tag fits in 16 bits tags16 holds the tags instead,
+ * twice as many to a host cache line.  rank holds each way's
+ * LRU position (0 is MRU and assoc - 1 is LRU), its insertion age under
+ * FIFO or its RRPV under SRRIP/BRRIP.  Tree PLRU keeps assoc - 1 bits per
+ * set in plru instead.
+ */
+struct cache
+{
+    const char *name;
+    void *arena;                    // mapping every array below except the shadow and prefetcher comes from
+    size_t arena_size;
+    uint *tags;                     // (1 << index) * assoc tags, NULL if tags16 holds them
+    uint16_t *tags16;
+    uint64_t *valid;                // one valid bit per way, per set
+    BYTE *rank;                     // (1 << index) * rank_stride LRU ranks
+    int rank_stride;                // assoc rounded up to 16 so a set is whole vectors
+    uint64_t *plru;                 // tree bits of each set, node n is bit n
+    uint64_t random_state;          // xorshift state for random and BRRIP
+    int policy;
+    int index;
+    int blocksize;
+    int blockoffsetbits;
+    int assoc;
+    int latency;                    // cycles for an access that hits here
+    unsigned long size;
+    long miss;
+    long access;
+    long hit;
+    long fills;                     // misses that filled an empty way
+    long evictions;                 // misses that replaced a valid line
+    long invalidations;             // lines dropped for an inclusive level below
+    long access_cycles;             // L1 only, cycles spent on all its accesses
+    int evicted;                    // the last fill replaced the block at evicted_address
+    uint evicted_address;
+    int evicted_dirty;              // and that block was dirty
+    uint64_t *dirty;                // one dirty bit per way, per set, NULL but under the write model
+    long writes;                    // blocks written into this level from above
+    long writebacks;                // dirty blocks this level wrote to the one below
+    shadow_t *shadow;               // 3C classification of the misses, if not NULL
+    long compulsory;
+    long capacity;
+    long conflict;
+    prefetch_t *prefetch;           // L1 only, if not NULL
+    BYTE *coherence;                // L1D of a core under -u, the enum coherence_state of each way
+    uint64_t *touched;              // and the words of each way the core used, bit 63 for the rest
+};
 
-void iplc_sim_process_pipeline_jump(char *instruction)
+/*
+ * One simulator instance: the caches, the pipeline and all of the
+ * counters.  Nothing is shared between instances, so many can run at once.
+ * Options (branch_predict_taken, cache_policy, the hierarchy and predictor
+ * options, events, debug, dump_pipeline, verbose) are set by the caller before
+ * iplc_sim_init().
+ * Without split_l1 and lower_levels this is the original single cache, with
+ * l1i and l1d both pointing at it.
+ */
+struct iplc_sim
 {
-    /* You must implement this function */
-	iplc_sim_push_pipeline_stage();  //pushing the pipeline along
-    
-    //setting the pipeline fetch stage to the appropriate values
-	pipeline[FETCH].itype = JUMP;
-	pipeline[FETCH].instruction_address = instruction_address;
+    cache_t l1[2];                  // the unified L1, or the L1I and L1D
+    cache_t *l1i;                   // serves instruction fetches
+    cache_t *l1d;                   // serves LW/SW
+    cache_t lower[MAX_LOWER_LEVELS]; // shared L2 and L3, set index/blocksize/assoc/latency first
+    long memory_accesses;
+    long memory_writes;             // blocks written to memory under the write model
+    long stores;
 
-    //copying the instruction
-	strcpy(pipeline[FETCH].stage.jump.instruction, instruction);
-}
+    /*
+     * Coalescing write buffer, a ring of write_buffer_size pending block
+     * writes and the cycle each one is done.
+     */
+    unsigned int *write_buffer_block;
+    unsigned int *write_buffer_ready;
+    int write_buffer_head;
+    int write_buffer_count;
+    unsigned int write_buffer_last; // when the newest entry is done
+    long write_buffer_coalesced;
+    long write_buffer_full;
+    unsigned long write_buffer_stall_cycles;
 
-void iplc_sim_process_pipeline_syscall()
-{
-    /* You must implement this function */
-	iplc_sim_push_pipeline_stage();  //pushing the pipeline along
-    
-    //setting the pipeline fetch stage to the appropriate values
-	pipeline[FETCH].itype = SYSCALL;
-	pipeline[FETCH].instruction_address = instruction_address;
+    /*
+     * Non-blocking L1D: the blocks being fetched and the cycle each fill is
+     * done, in no order, and the cycle each register's load data arrives.
+     */
+    unsigned int *mshr_block;
+    unsigned int *mshr_ready;
+    int mshr_count;
+    unsigned int register_ready[MAX_REGISTERS];
+    long mshr_primary;              // misses that took an MSHR
+    long mshr_secondary;            // accesses merged into a busy one
+    long mshr_outstanding;          // sum of the busy MSHRs as each primary miss took one
+    long mshr_full;
+    unsigned long mshr_full_cycles;
+    unsigned long mshr_use_cycles;  // stalls waiting for a missed load's register
 
-}
+    /*
+     * Scoreboard: the cycle each register's newest result leaves EX (or
+     * MEM for a LW), and the stalls by hazard kind.
+     */
+    unsigned int result_ready[MAX_REGISTERS];
+    BYTE result_load[MAX_REGISTERS];
+    long hazard_stalls[HAZARD_COUNT];
+    unsigned long hazard_cycles[HAZARD_COUNT];
 
-void iplc_sim_process_pipeline_nop()
-{
-    /* You must implement this function */
-	iplc_sim_push_pipeline_stage();  //pushing the pipeline along
-    
-    //setting the pipeline fetch stage to the appropriate values
-	pipeline[FETCH].itype = NOP;
-	pipeline[FETCH].instruction_address = instruction_address;
-}
+    pipeline_t pipeline[MAX_STAGES]; // ring, stage i is pipeline[(pipeline_head + i) % MAX_STAGES]
+    int pipeline_head;
 
-/************************************************************************************************/
-/* parse Function *******************************************************************************/
-/************************************************************************************************/
+    /*
+     * Superscalar pipeline: the same ring of pipeline_depth groups when
+     * issue_width is set, pipeline[] is unused then.
+     */
+    pipeline_group_t group[MAX_DEPTH];
+    long group_ends[GROUP_END_COUNT];
+    long group_retired[MAX_WIDTH + 1]; // cycles by how many instructions WRITEBACK retired
+    unsigned int instruction_address;
+    unsigned int pipeline_cycles;   // how many cycles did you pipeline consume
+    unsigned int instruction_count; // home many real instructions ran thru the pipeline
+    unsigned int branch_predict_taken;
+    unsigned int branch_count;
+    unsigned int correct_branch_predictions;
+    unsigned int branch_mispredictions;
+    unsigned int btb_misses;
+    long fetch_accesses;            // the L1 accesses split by kind, even when unified
+    long fetch_misses;
+    long data_accesses;
+    long data_misses;
+
+    /*
+     * Stall cycles by cause.  Every push costs one cycle, anything above
+     * that is a stall; the extra pushes of a fetch miss are fetch stalls.
+     */
+    unsigned long stall_fetch;
+    unsigned long stall_data;
+    unsigned long stall_branch;
+    unsigned long stall_load_use;
+
+    /*
+     * Translation (-L, -Y).  tlb[TLB_L2].assoc is 0 without an L2 TLB.
+     * The translation cycles are also in stall_fetch and stall_data.
+     */
+    cache_t tlb[TLB_COUNT];
+    long walks;
+    unsigned long walk_cycles;
+    long walk_loads;                // page table entries loaded through the L1D
+    long walk_load_misses;
+    unsigned long stall_fetch_tlb;
+    unsigned long stall_data_tlb;
+
+    interval_stats_t interval_last; // totals at the end of the previous interval
+    unsigned int interval_next;     // instruction_count that ends this interval
+    int interval_index;
+
+    unsigned int sample_position;   // instructions into the current sampling period
+    unsigned int sample_start_cycles; // pipeline_cycles when the detailed window began
+    unsigned int functional_branch; // fast-forwarded branch waiting for its successor
+    unsigned long sample_instructions;
+    long sample_count;              // detailed windows measured
+    double sample_sum;              // of their CPIs
+    double sample_sum_squares;
+
+    /*
+     * Predictor tables, 2 bit counters indexed by the branch's address at
+     * DECODE (gshare xors in the global history).  The tournament chooser
+     * picks gshare when its counter is 2 or 3.
+     */
+    BYTE *bimodal_table;
+    BYTE *gshare_table;
+    BYTE *chooser_table;
+    uint branch_history;
+    uint *btb_tags;                 // 1 << btb_bits branch addresses, 0 is empty
+    uint *btb_targets;
+
+    unsigned int debug;
+    unsigned int dump_pipeline;
+    unsigned int verbose;           // one of the VERBOSE_ levels
+    event_log_t *events;            // every access, branch and retirement, if not NULL
+    profile_t *profile;             // stalls and misses by PC, if not NULL
+    unsigned int report_policy;     // add the replacement policy statistics to finalize
+    int cache_policy;
+    int split_l1;                   // separate L1I and L1D instead of one L1
+    int lower_levels;               // how many of lower[] are in use
+    int inclusion;
+    int l1_latency;                 // 0 means 1, a hit costs no stall
+    int memory_latency;             // 0 means CACHE_MISS_DELAY
+    int predictor;
+    int predictor_bits;             // log2 entries per table, 0 means PREDICT_TABLE_BITS
+    int history_bits;               // gshare history length, 0 means predictor_bits
+    int btb_bits;                   // log2 BTB entries, 0 means no BTB (targets always known)
+    unsigned int report_predictor;  // add the predictor statistics to finalize
+    unsigned int interval;          // CSV row every this many retired instructions, 0 for none
+    FILE *interval_file;            // where the rows go, stdout if NULL
+    unsigned int sample_ff;         // sampling period: fast-forward, warmup and detailed
+    unsigned int sample_warmup;     // lengths in instructions, sample_detail 0 runs
+    unsigned int sample_detail;     // every instruction in detail
+    int classify_misses;            // split every level's misses into the 3Cs
+    int write_model;                // track dirty lines and write traffic, stores use iplc_sim_store()
+    int write_through;              // L1D policy, the lower levels are always write-back
+    int write_no_allocate;
+    int write_buffer_size;          // entries, 0 for no write buffer
+    int prefetcher;                 // of each L1, PREFETCH_NONE for none
+    int prefetch_degree;            // 0 means PREFETCH_DEGREE
+    int prefetch_latency;           // 0 means the latency of the level a prefetch comes from
+    int mshrs;                      // of the L1D, 0 for the blocking cache
+    int scoreboard;                 // RAW hazards of every instruction instead of the original load-use check
+    int forwarding;                 // enum forwarding, under the scoreboard
+    int issue_width;                // superscalar group size, 0 for the original pipeline
+    int pipeline_depth;             // superscalar stages, the extra ones fetch before DECODE
+    int memory_ports;               // LW/SW per group
+    int alus;                       // RTYPE per group
+    int tlb_entries;                // of each L1 TLB, 0 for no translation
+    int tlb_assoc;
+    int l2_tlb_entries;             // 0 for no L2 TLB
+    int l2_tlb_assoc;
+    int l2_tlb_latency;             // 0 means TLB_L2_LATENCY
+    int page_bits;                  // PAGE_4K_BITS or PAGE_2M_BITS, 0 means 4K
+    int walk_latency;               // cycles per page table level, 0 means memory_latency
+    int walk_through_cache;         // load the page table entries through the L1D instead
+    unsigned int access_pc;         // the LW/SW behind the current L1D access, 0 for a fetch
+    int functional;                 // fast-forwarding, accesses take no time
+
+    /*
+     * One core of a multi-core run (-u): the L2 and the bus are shared,
+     * and the coherence traffic this core caused or received.
+     */
+    multicore_t *multicore;         // NULL for a single core
+    int core_id;
+    long bus_reads;                 // BusRd, a load missed
+    long bus_read_exclusives;       // BusRdX, a store missed
+    long bus_upgrades;              // BusUpgr, a store hit a shared or owned copy
+    long cache_transfers;           // misses another core's L1D supplied
+    long invalidations_sent;
+    long invalidations_received;
+    long false_sharing;             // received for words this core never used
+    long coherence_misses;          // misses of blocks an invalidation took
+    long coherence_writebacks;      // dirty copies written to the L2 when another core read them
+    uint *coherence_lost;           // 1 << COHERENCE_LOST_BITS invalidated blocks + 1, 0 is empty
+};
+
+#define SWEEP_MAX_VALUES 32   // most values accepted for one swept parameter
+#define SWEEP_DATA_LAG 4      // pushes from FETCH until a LW/SW is traped in MEM
 
 /*
- * Don't touch this function.  It is for parsing the instruction stream.
+ * One swept configuration.  Each set is kept as an LRU stack (MRU first) so
+ * a hit also tells us its stack distance.  Configurations can not share one
+ * Mattson stack: on an instruction miss the pipeline is pushed until empty,
+ * which moves pending LW/SW data accesses ahead of later fetches, so the
+ * reference order seen by iplc_sim_trap_address() depends on each
+ * configuration's own hits and misses.
  */
-unsigned int iplc_sim_parse_reg(char *reg_str)
+typedef struct sweep_cache
 {
-    int i;
-    // turn comma into \n
-    if (reg_str[strlen(reg_str)-1] == ',')
-        reg_str[strlen(reg_str)-1] = '\n';
-    
-    if (reg_str[0] != '$')
-        return atoi(reg_str);
-    else {
-        // copy down over $ character than return atoi
-        for (i = 0; i < strlen(reg_str); i++)
-            reg_str[i] = reg_str[i+1];
+    int index;
+    int blocksize;
+    int blockoffsetbits;
+    int assoc;
+    uint *tags;      // (1 << index) stacks of assoc tags, MRU first
+    int *depth;      // how many tags are valid in each stack
+    long *distance;  // stack distance histogram of the hits
+    long access;
+    long miss;
+    long pushes;     // pipeline pushes so far, used to time the data accesses
+    uint pending[SWEEP_DATA_LAG];   // LW/SW data addresses still in the pipeline
+    long pending_at[SWEEP_DATA_LAG]; // push on which each pending access happens
+    int pending_head;
+    int pending_count;
+} sweep_cache_t;
+
+sweep_cache_t *sweep_caches=NULL;
+int sweep_cache_count=0;
+int sweep_index[SWEEP_MAX_VALUES] = {2, 3, 4, 5, 6, 7};
+int sweep_index_count=6;
+int sweep_blocksize[SWEEP_MAX_VALUES] = {1, 2, 4, 8};
+int sweep_blocksize_count=4;
+int sweep_assoc[SWEEP_MAX_VALUES] = {1, 2, 4, 8, 16};
+int sweep_assoc_count=5;
+
+// Single pass miss-ratio-curve sweep
+int iplc_sim_sweep_parse_list(char *list, int *values);
+int iplc_sim_sweep_parse_policies(char *list, int *values);
+void iplc_sim_sweep_init();
+int iplc_sim_sweep_access(sweep_cache_t *config, unsigned int address);
+void iplc_sim_sweep_instruction(unsigned int address, int is_mem, unsigned int data_address);
+void iplc_sim_sweep_run(trace_t *trace);
+void iplc_sim_sweep_finalize();
+
+/*
+ * One configuration of a parallel parameter sweep and its results.
+ */
+typedef struct runner_job
+{
+    int index;
+    int blocksize;
+    int assoc;
+    int policy;
+    int branch_predict_taken;
+    int status;              // 0 once run, -1 if the cache is too big
+    unsigned long cache_size;
+    long cache_access;
+    long cache_hit;
+    long cache_miss;
+    long cache_evictions;
+    unsigned int pipeline_cycles;
+    unsigned int instruction_count;
+    unsigned int branch_count;
+    unsigned int correct_branch_predictions;
+    unsigned int branch_mispredictions;
+} runner_job_t;
+
+/*
+ * Each worker owns a contiguous range of jobs.  It takes from the front
+ * and, once it runs dry, steals the back half of another worker's range.
+ */
+typedef struct runner_queue
+{
+    pthread_mutex_t lock;
+    int head, tail;          // jobs [head, tail) not started yet
+} runner_queue_t;
+
+runner_job_t *runner_jobs=NULL;
+int runner_job_count=0;
+runner_queue_t *runner_queues=NULL;
+int runner_threads=0;        // 0 means one per online processor
+int runner_json=FALSE;
+iplc_sim_t runner_template;  // hierarchy options every job starts from
+BYTE *runner_trace=NULL;     // the decoded trace, shared read only by all workers
+size_t runner_trace_len=0;
+int runner_trace_version=TRACE_VERSION; // of the records in runner_trace
+int sweep_branch[SWEEP_MAX_VALUES] = {0, 1};
+int sweep_branch_count=2;
+int sweep_policy[SWEEP_MAX_VALUES] = {POLICY_LRU};
+int sweep_policy_count=1;
+
+// Parallel parameter sweep
+void iplc_sim_runner_load(trace_t *trace);
+void iplc_sim_runner_run_job(runner_job_t *job);
+int iplc_sim_runner_take(int self);
+void *iplc_sim_runner_worker(void *arg);
+void iplc_sim_runner_run(trace_t *trace);
+void iplc_sim_runner_report();
+
+/*
+ * Coherence protocols of a multi-core run, and the states of an L1D line.
+ * MESI writes a modified block back to the L2 when another core reads
+ * it; MOESI keeps it dirty in the Owned state and supplies it from there.
+ */
+enum protocol {PROTOCOL_MESI, PROTOCOL_MOESI, PROTOCOL_COUNT};
+
+const char *protocol_names[PROTOCOL_COUNT] = {"mesi", "moesi"};
+
+enum coherence_state {STATE_I, STATE_S, STATE_E, STATE_O, STATE_M};
+
+#define MAX_CORES 16
+#define COHERENCE_QUANTUM 1000      // cycles a core may run ahead before it waits for the others
+#define COHERENCE_LOST_BITS 12      // log2 entries of each core's table of invalidated blocks
+#define COHERENCE_BLOCK_BITS 10     // log2 of the block table's starting size
+#define COHERENCE_TOP 10            // blocks in the false sharing report
+
+/*
+ * Coherence traffic of one block, for the false sharing report.
+ */
+typedef struct block_stats
+{
+    uint block;                     // block address + 1, 0 is an empty slot
+    long invalidations;
+    long false_sharing;
+    long coherence_misses;
+} block_stats_t;
+
+/*
+ * A multi-core run: one simulator per core, each with its own trace, L1I
+ * and L1D, on its own host thread.  The cores share an L2 that is neither
+ * inclusive nor exclusive, and keep their L1Ds coherent by snooping a
+ * bus.  Every bus transaction and L2 access holds bus; a core's L1D is
+ * only touched with its l1d_lock held, so an L1D hit needs no more.  The
+ * cores meet every quantum cycles, so none runs further ahead than that.
+ */
+struct multicore
+{
+    int protocol;
+    int cores;
+    iplc_sim_t *core;
+    trace_t **trace;
+    char **trace_names;
+    cache_t l2;
+    long memory_writes;             // dirty L2 victims
+    pthread_mutex_t bus;
+    pthread_mutex_t l1d_lock[MAX_CORES];
+    block_stats_t *blocks;          // open addressing, grown at half full, under bus
+    uint block_mask;
+    int block_shift;                // 32 - log2 of the table size
+    long block_count;
+    pthread_mutex_t sync;
+    pthread_cond_t advance;
+    unsigned int quantum;
+    unsigned int epoch_end;         // the cycle every core runs to before the next meeting
+    int waiting;
+    int active;                     // cores still running their traces
+    long generation;
+};
+
+// Multi-core functions
+int iplc_sim_parse_protocol(char *name);
+block_stats_t *iplc_sim_block_stats(multicore_t *mc, uint block);
+int iplc_sim_shared_walk(iplc_sim_t *sim, unsigned int address);
+void iplc_sim_shared_write(multicore_t *mc, unsigned int address);
+int iplc_sim_snoop(iplc_sim_t *sim, unsigned int address, int write, int *shared);
+int iplc_sim_coherent_access(iplc_sim_t *sim, unsigned int address, int write, int *cycles);
+void iplc_sim_multicore_sync(multicore_t *mc, unsigned int *epoch_end);
+void *iplc_sim_core_run(void *arg);
+void iplc_sim_coherence_report(multicore_t *mc);
+int iplc_sim_multicore_run(iplc_sim_t *template, int protocol, unsigned int quantum, trace_t *first,
+                           char **trace_names, int cores, int index, int blocksize, int assoc);
+
+#define BENCH_COUNT 1000000          // instructions of each pattern
+#define BENCH_REPEATS 5              // runs per pattern, the fastest counts
+#define BENCH_INDEX 4
+#define BENCH_BLOCKSIZE 4
+#define BENCH_ASSOC 2
+#define BENCH_TOLERANCE 0.10         // slowdown against the baseline that gets flagged
+
+// Throughput benchmark
+int iplc_sim_bench_run(iplc_sim_t *template, char *baseline_name);
+
+/************************************************************************************************/
+/* Cache Functions ******************************************************************************/
+/************************************************************************************************/
+/*
+ * Map size zeroed bytes for the arrays of one cache level, size is rounded
+ * up to what was mapped.  Big arenas come from the huge pages reserved on
+ * the host if there are any, and are otherwise offered to transparent huge
+ * pages.  Returns NULL if there is not enough memory.
+ */
+void *iplc_sim_arena_map(size_t *size)
+{
+    void *arena = MAP_FAILED;
+
+    if (*size >= HUGE_PAGE_SIZE) {
+        *size = (*size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+#ifdef MAP_HUGETLB
+        arena = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    }
+    if (arena == MAP_FAILED) {
+        arena = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (arena == MAP_FAILED)
+            return NULL;
+#ifdef MADV_HUGEPAGE
+        if (*size >= HUGE_PAGE_SIZE)
+            madvise(arena, *size, MADV_HUGEPAGE);
+#endif
+    }
+    return arena;
+}
+
+/*
+ * Check that 1 << index sets of blocksize words leave at least one tag bit
+ * of a 32 bit address, so the tag shift stays below 32.  Returns FALSE,
+ * saying why if verbose, when they do not.
+ */
+int iplc_sim_cache_geometry(int index, int blocksize, int verbose)
+{
+    if (index < 0 || index > MAX_INDEX_BITS) {
+        if (verbose)
+            printf("Index must be between 0 and %d bits .... \n", MAX_INDEX_BITS);
+        return FALSE;
+    }
+    if (blocksize < 1) {
+        if (verbose)
+            printf("BlockSize must be at least 1 .... \n");
+        return FALSE;
+    }
+    if (index + (int) rint(log((double) blocksize * 4) / log(2)) >= 32) {
+        if (verbose)
+            printf("Index and BlockOffSetBits must leave a tag bit .... \n");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Configure one cache level and allocate its arrays, with dirty bits if
+ * dirty is set.  A name of "" is the single unified cache of the original
+ * simulator.  Returns -1 if the index and block offset leave no tag
+ * bits, the cache has more than MAX_CACHE_LINES lines, the associativity
+ * does not suit the replacement policy or the host is out of memory.
+ */
+int iplc_sim_cache_init(cache_t *cache, const char *name, int index, int blocksize, int assoc,
+                        int policy, int latency, int dirty, int verbose)
+{
+    size_t sets, total_lines, stride, tags_size, bits_size, rank_size, i;
+    BYTE *next;
+    int short_tags;
+    unsigned long cache_size = 0;
+    cache->name = name;
+    cache->arena = NULL;
+    cache->shadow = NULL;
+    cache->dirty = NULL;
+    cache->prefetch = NULL;
+    cache->coherence = NULL;
+    cache->touched = NULL;
+    cache->tags = NULL;
+    cache->tags16 = NULL;
+    cache->valid = NULL;
+    cache->rank = NULL;
+    cache->plru = NULL;
+    cache->index = index;
+    cache->blocksize = blocksize;
+    cache->assoc = assoc;
+    cache->policy = policy;
+    cache->latency = latency;
+    
+    if (!iplc_sim_cache_geometry(index, blocksize, verbose))
+        return -1;
+    
+    cache->blockoffsetbits =
+    (int) rint((log( (double) blocksize * 4 )/ log(2)));
+    /* Note: rint function rounds the result up prior to casting */
+    
+    cache_size = (unsigned long) assoc * ( 1 << index ) * ((32UL * blocksize) + 33 - index - cache->blockoffsetbits);
+    cache->size = cache_size;
+    
+    if (verbose) {
+        if (name[0])
+            printf("%s Cache Configuration \n", name);
+        else
+            printf("Cache Configuration \n");
+        printf("   Index: %d bits or %d lines \n", cache->index, (1<<cache->index) );
+        printf("   BlockSize: %d \n", cache->blocksize );
+        printf("   Associativity: %d \n", cache->assoc );
+        printf("   BlockOffSetBits: %d \n", cache->blockoffsetbits );
+        printf("   CacheSize: %lu \n", cache_size );
+        if (policy != POLICY_LRU)
+            printf("   Replacement: %s \n", policy_names[policy] );
+        if (name[0])
+            printf("   Latency: %d \n", latency );
+    }
+    
+    if ((size_t) assoc << index > MAX_CACHE_LINES) {
+        if (verbose)
+            printf("Cache too big. More than %d lines .... \n", MAX_CACHE_LINES);
+        return -1;
+    }
+    
+    if (assoc < 1 || assoc > MAX_ASSOC) {
+        if (verbose)
+            printf("Associativity must be between 1 and %d .... \n", MAX_ASSOC);
+        return -1;
+    }
+    
+    if (policy == POLICY_PLRU && (assoc & (assoc - 1))) {
+        if (verbose)
+            printf("Tree PLRU needs a power of two associativity .... \n");
+        return -1;
+    }
+    
+    // Dynamically create our cache based on the information the user entered, every array in one arena
+    sets = (size_t) 1 << index;
+    total_lines = sets * assoc;
+    cache->rank_stride = (assoc + 15) & ~15;
+    stride = cache->rank_stride;
+    short_tags = 32 - index - cache->blockoffsetbits <= 16;
+    tags_size = (total_lines + TAG_PAD) * (short_tags ? sizeof(uint16_t) : sizeof(uint));
+    tags_size = (tags_size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+    bits_size = (sets * sizeof(uint64_t) + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+    rank_size = (sets * stride + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+    cache->arena_size = tags_size + bits_size + rank_size;
+    cache->arena_size += ((policy == POLICY_PLRU) + (dirty != 0)) * bits_size;
+    if ((cache->arena = iplc_sim_arena_map(&cache->arena_size)) == NULL) {
+        if (verbose)
+            printf("Not enough memory for the cache .... \n");
+        return -1;
+    }
+    next = (BYTE*) cache->arena;
+    if (short_tags)
+        cache->tags16 = (uint16_t*) next;
+    else
+        cache->tags = (uint*) next;
+    next += tags_size;
+    cache->valid = (uint64_t*) next;
+    next += bits_size;
+    cache->rank = next;
+    next += rank_size;
+    if (policy == POLICY_PLRU) {
+        cache->plru = (uint64_t*) next;
+        next += bits_size;
+    }
+    if (dirty)
+        cache->dirty = (uint64_t*) next;
+    
+    // the empty ways are ranked below the valid ones, in way order, copied from the first set on
+    for (i = 0; i < stride; i++)
+        cache->rank[i] = i < (size_t) assoc ? i : RANK_PAD;
+    for (i = stride; i < sets * stride; i *= 2)
+        memcpy(cache->rank + i, cache->rank, i < sets * stride - i ? i : sets * stride - i);
+    cache->random_state = 0x9e3779b97f4a7c15ULL;   // fixed so runs repeat exactly
+    
+    cache->miss = cache->access = cache->hit = 0;
+    cache->fills = cache->evictions = cache->invalidations = 0;
+    cache->writes = cache->writebacks = 0;
+    cache->evicted = cache->evicted_dirty = FALSE;
+    return 0;
+}
+
+/*
+ * Release the arrays of one cache level.
+ */
+void iplc_sim_cache_free(cache_t *cache)
+{
+    if (cache->arena)
+        munmap(cache->arena, cache->arena_size);
+    free(cache->coherence);
+    free(cache->touched);
+    cache->arena = NULL;
+    cache->tags = NULL;
+    cache->tags16 = NULL;
+    cache->valid = NULL;
+    cache->rank = NULL;
+    cache->plru = NULL;
+    cache->dirty = NULL;
+    cache->coherence = NULL;
+    cache->touched = NULL;
+    iplc_sim_shadow_free(cache);
+    iplc_sim_prefetch_free(cache);
+}
+
+/*
+ * Start the 3C classification of a cache: an empty shadow as big as the
+ * cache and an empty seen set.
+ */
+void iplc_sim_shadow_init(cache_t *cache)
+{
+    shadow_t *shadow = (shadow_t*) calloc(1, sizeof(shadow_t));
+    uint i;
+
+    shadow->capacity = (1 << cache->index) * cache->assoc;
+    shadow->nodes = (shadow_node_t*) malloc(shadow->capacity * sizeof(shadow_node_t));
+    shadow->head = shadow->tail = -1;
+    shadow->shift = 32 - SHADOW_MIN_BITS;
+    shadow->mask = (1 << SHADOW_MIN_BITS) - 1;
+    shadow->slots = (shadow_slot_t*) malloc((shadow->mask + 1) * sizeof(shadow_slot_t));
+    for (i = 0; i <= shadow->mask; i++)
+        shadow->slots[i].node = SHADOW_EMPTY;
+    cache->shadow = shadow;
+    cache->compulsory = cache->capacity = cache->conflict = 0;
+}
+
+void iplc_sim_shadow_free(cache_t *cache)
+{
+    if (cache->shadow) {
+        free(cache->shadow->slots);
+        free(cache->shadow->nodes);
+        free(cache->shadow);
+        cache->shadow = NULL;
+    }
+}
+
+/*
+ * The hash slot of block: the one holding it, or the empty slot it would
+ * go in.  Fibonacci hashing, then linear probing.  Nothing is ever
+ * deleted, so there are no tombstones.
+ */
+static inline shadow_slot_t *iplc_sim_shadow_slot(shadow_t *shadow, uint block)
+{
+    uint i = (block * 0x9e3779b9u) >> shadow->shift;
+
+    while (shadow->slots[i].node != SHADOW_EMPTY && shadow->slots[i].block != block)
+        i = (i + 1) & shadow->mask;
+    return &shadow->slots[i];
+}
+
+/*
+ * Double the seen set once it is half full.
+ */
+void iplc_sim_shadow_grow(shadow_t *shadow)
+{
+    shadow_slot_t *old = shadow->slots;
+    uint old_size = shadow->mask + 1, i;
+
+    shadow->mask = 2 * old_size - 1;
+    shadow->shift--;
+    shadow->slots = (shadow_slot_t*) malloc(2 * old_size * sizeof(shadow_slot_t));
+    for (i = 0; i <= shadow->mask; i++)
+        shadow->slots[i].node = SHADOW_EMPTY;
+    for (i = 0; i < old_size; i++) {
+        if (old[i].node != SHADOW_EMPTY)
+            *iplc_sim_shadow_slot(shadow, old[i].block) = old[i];
+    }
+    free(old);
+}
+
+/*
+ * Run one access of the real cache through the shadow.  A miss of the
+ * real cache is compulsory if the block was never asked for before,
+ * capacity if the fully associative shadow misses it too, and conflict if
+ * only the real cache's set mapping lost it.  Either way the block ends
+ * up MRU in the shadow.
+ */
+void iplc_sim_shadow_access(cache_t *cache, unsigned int address, int hit)
+{
+    shadow_t *shadow = cache->shadow;
+    shadow_node_t *nodes = shadow->nodes;
+    uint block = address >> cache->blockoffsetbits;
+    shadow_slot_t *slot = iplc_sim_shadow_slot(shadow, block);
+    int node = slot->node;
+
+    if (node == SHADOW_EMPTY) {
+        cache->compulsory += !hit;
+        slot->block = block;
+        shadow->used++;
+    }
+    else if (node == SHADOW_OUT) {
+        cache->capacity += !hit;
+    }
+    else {
+        cache->conflict += !hit;
+        if (node == shadow->head)
+            return;
+        // unlink, it goes back in at the head below
+        nodes[nodes[node].prev].next = nodes[node].next;
+        if (nodes[node].next >= 0)
+            nodes[nodes[node].next].prev = nodes[node].prev;
+        else
+            shadow->tail = nodes[node].prev;
+    }
+
+    if (node < 0) {
+        if (shadow->resident < shadow->capacity) {
+            node = shadow->resident++;
+        }
+        else {
+            // the LRU block leaves the shadow, but stays seen
+            node = shadow->tail;
+            shadow->tail = nodes[node].prev;
+            if (shadow->tail >= 0)
+                nodes[shadow->tail].next = -1;
+            else
+                shadow->head = -1;
+            iplc_sim_shadow_slot(shadow, nodes[node].block)->node = SHADOW_OUT;
+        }
+        nodes[node].block = block;
+        slot->node = node;
+    }
+
+    nodes[node].prev = -1;
+    nodes[node].next = shadow->head;
+    if (shadow->head >= 0)
+        nodes[shadow->head].prev = node;
+    else
+        shadow->tail = node;
+    shadow->head = node;
+
+    if (2 * shadow->used > shadow->mask)
+        iplc_sim_shadow_grow(shadow);
+}
+
+/*
+ * Correctly configure the caches and reset the pipeline and counters.  The
+ * L1 geometry comes from the arguments, everything else from the options
+ * already set in sim: split_l1, lower_levels and the lower[] geometries,
+ * l1_latency, memory_latency, inclusion, cache_policy, write_model and the
+ * TLB options.
+ * Returns -1 if any level can not be built.
+ */
+int iplc_sim_init(iplc_sim_t *sim, int index, int blocksize, int assoc)
+{
+    int i=0;
+    int hierarchy = sim->split_l1 || sim->lower_levels;
+    cache_t *upper;
+    
+    if (sim->l1_latency <= 0)
+        sim->l1_latency = 1;
+    if (sim->memory_latency <= 0)
+        sim->memory_latency = CACHE_MISS_DELAY;
+    
+    bzero(sim->l1, sizeof(sim->l1));
+    sim->l1i = &sim->l1[0];
+    sim->l1d = sim->split_l1 ? &sim->l1[1] : &sim->l1[0];
+    for (i = 0; i < sim->lower_levels; i++) {
+        cache_t config = sim->lower[i];
+        
+        bzero(&sim->lower[i], sizeof(cache_t));
+        sim->lower[i].index = config.index;
+        sim->lower[i].blocksize = config.blocksize;
+        sim->lower[i].assoc = config.assoc;
+        sim->lower[i].latency = config.latency;
+    }
+    
+    if (iplc_sim_cache_init(sim->l1i, !hierarchy ? "" : sim->split_l1 ? "L1I" : "L1", index, blocksize,
+                            assoc, sim->cache_policy, sim->l1_latency, sim->write_model,
+                            sim->verbose >= VERBOSE_CONFIG) < 0)
+        return -1;
+    if (sim->split_l1 &&
+        iplc_sim_cache_init(sim->l1d, "L1D", index, blocksize, assoc, sim->cache_policy,
+                            sim->l1_latency, sim->write_model, sim->verbose >= VERBOSE_CONFIG) < 0)
+        return -1;
+    
+    upper = sim->l1i;
+    for (i = 0; i < sim->lower_levels; i++) {
+        cache_t *cache = &sim->lower[i];
         
-        return atoi(reg_str);
+        if (iplc_sim_cache_init(cache, i ? "L3" : "L2", cache->index, cache->blocksize, cache->assoc,
+                                sim->cache_policy, cache->latency, sim->write_model,
+                                sim->verbose >= VERBOSE_CONFIG) < 0)
+            return -1;
+        // back invalidation and victim moves work on whole lower level blocks
+        if (cache->blocksize < upper->blocksize ||
+            (sim->inclusion == INCLUSION_EXCLUSIVE && cache->blocksize != upper->blocksize)) {
+            if (sim->verbose >= VERBOSE_CONFIG)
+                printf("%s BlockSize must be %s the level above it .... \n", cache->name,
+                       sim->inclusion == INCLUSION_EXCLUSIVE ? "the same as" : "at least");
+            return -1;
+        }
+        upper = cache;
+    }
+    if (sim->write_model) {
+        if (sim->inclusion == INCLUSION_EXCLUSIVE) {
+            if (sim->verbose >= VERBOSE_CONFIG)
+                printf("Write policies need an inclusive or nine hierarchy .... \n");
+            return -1;
+        }
+        if (sim->write_buffer_size) {
+            sim->write_buffer_block = (unsigned int*) calloc(sim->write_buffer_size, sizeof(unsigned int));
+            sim->write_buffer_ready = (unsigned int*) calloc(sim->write_buffer_size, sizeof(unsigned int));
+        }
+        if (sim->verbose >= VERBOSE_CONFIG) {
+            printf("Write Policy \n");
+            printf("   L1D: %s, %s \n", sim->write_through ? "write-through" : "write-back",
+                   sim->write_no_allocate ? "no-write-allocate" : "write-allocate");
+            printf("   WriteBuffer: %d entries \n", sim->write_buffer_size);
+        }
+    }
+    sim->write_buffer_head = sim->write_buffer_count = 0;
+    sim->write_buffer_last = 0;
+    sim->write_buffer_coalesced = sim->write_buffer_full = 0;
+    sim->write_buffer_stall_cycles = 0;
+    if (sim->prefetcher) {
+        iplc_sim_prefetch_init(sim, sim->l1i);
+        if (sim->split_l1)
+            iplc_sim_prefetch_init(sim, sim->l1d);
+        if (sim->verbose >= VERBOSE_CONFIG) {
+            printf("Prefetcher \n");
+            printf("   Kind: %s \n", prefetcher_names[sim->prefetcher]);
+            printf("   Degree: %d \n", sim->l1i->prefetch->degree);
+            printf("   Latency: %d \n", sim->prefetch_latency);
+        }
+    }
+    if (iplc_sim_tlb_init(sim) < 0)
+        return -1;
+    sim->access_pc = 0;
+    sim->functional = FALSE;
+    if (sim->mshrs) {
+        sim->mshr_block = (unsigned int*) calloc(sim->mshrs, sizeof(unsigned int));
+        sim->mshr_ready = (unsigned int*) calloc(sim->mshrs, sizeof(unsigned int));
+        if (sim->verbose >= VERBOSE_CONFIG)
+            printf("Non-blocking Data Cache \n   MSHRs: %d \n", sim->mshrs);
+    }
+    sim->mshr_count = 0;
+    bzero(sim->register_ready, sizeof(sim->register_ready));
+    sim->mshr_primary = sim->mshr_secondary = sim->mshr_outstanding = sim->mshr_full = 0;
+    sim->mshr_full_cycles = sim->mshr_use_cycles = 0;
+    bzero(sim->result_ready, sizeof(sim->result_ready));
+    bzero(sim->result_load, sizeof(sim->result_load));
+    bzero(sim->hazard_stalls, sizeof(sim->hazard_stalls));
+    bzero(sim->hazard_cycles, sizeof(sim->hazard_cycles));
+    if (sim->scoreboard && sim->verbose >= VERBOSE_CONFIG)
+        printf("Scoreboard \n   Forwarding: %s \n", forwarding_names[sim->forwarding]);
+    if (sim->classify_misses) {
+        iplc_sim_shadow_init(sim->l1i);
+        if (sim->split_l1)
+            iplc_sim_shadow_init(sim->l1d);
+        for (i = 0; i < sim->lower_levels; i++)
+            iplc_sim_shadow_init(&sim->lower[i]);
+    }
+    if (hierarchy && sim->verbose >= VERBOSE_CONFIG) {
+        printf("Hierarchy \n");
+        printf("   Inclusion: %s \n", inclusion_names[sim->inclusion] );
+        printf("   MemoryLatency: %d \n", sim->memory_latency );
+    }
+    
+    // init the pipeline -- set all data to zero and instructions to NOP
+    for (i = 0; i < MAX_STAGES; i++) {
+        // itype is set to O which is NOP type instruction
+        bzero(&(sim->pipeline[i]), sizeof(pipeline_t));
+    }
+    sim->pipeline_head = 0;
+    bzero(sim->group, sizeof(sim->group));
+    bzero(sim->group_ends, sizeof(sim->group_ends));
+    bzero(sim->group_retired, sizeof(sim->group_retired));
+    if (sim->issue_width && sim->verbose >= VERBOSE_CONFIG) {
+        printf("Superscalar \n");
+        printf("   Width: %d \n", sim->issue_width);
+        printf("   Depth: %d \n", sim->pipeline_depth);
+        printf("   MemoryPorts: %d \n", sim->memory_ports);
+        printf("   ALUs: %d \n", sim->alus);
+    }
+    
+    sim->instruction_address = 0;
+    sim->pipeline_cycles = 0;
+    sim->instruction_count = 0;
+    sim->branch_count = 0;
+    sim->correct_branch_predictions = 0;
+    sim->memory_accesses = 0;
+    sim->memory_writes = sim->stores = 0;
+    sim->fetch_accesses = sim->fetch_misses = sim->data_accesses = sim->data_misses = 0;
+    sim->stall_fetch = sim->stall_data = sim->stall_branch = sim->stall_load_use = 0;
+    sim->sample_position = sim->sample_start_cycles = sim->functional_branch = 0;
+    sim->sample_instructions = 0;
+    sim->sample_count = 0;
+    sim->sample_sum = sim->sample_sum_squares = 0.0;
+    if (sim->interval)
+        iplc_sim_interval_init(sim);
+    else
+        sim->interval_next = 0;     // instruction_count is never 0 when it is checked
+    return iplc_sim_predictor_init(sim);
+}
+
+/*
+ * Release every cache of a simulator instance.
+ */
+void iplc_sim_free(iplc_sim_t *sim)
+{
+    int i;
+
+    iplc_sim_cache_free(&sim->l1[0]);
+    iplc_sim_cache_free(&sim->l1[1]);
+    for (i = 0; i < sim->lower_levels; i++)
+        iplc_sim_cache_free(&sim->lower[i]);
+    iplc_sim_tlb_free(sim);
+    iplc_sim_predictor_free(sim);
+    free(sim->write_buffer_block);
+    free(sim->write_buffer_ready);
+    sim->write_buffer_block = sim->write_buffer_ready = NULL;
+    free(sim->mshr_block);
+    free(sim->mshr_ready);
+    sim->mshr_block = sim->mshr_ready = NULL;
+    free(sim->coherence_lost);
+    sim->coherence_lost = NULL;
+}
+
+/*
+ * Find tag among the valid ways of a set.  Returns the way or -1.  The
+ * vector versions may read up to TAG_PAD tags past the set, those lanes are
+ * dropped by the valid mask.
+ */
+static inline int iplc_sim_find_way(const uint *tags, uint64_t valid, uint tag, int assoc)
+{
+    uint64_t match;
+    int i;
+
+#if defined(__AVX2__)
+    __m256i key = _mm256_set1_epi32(tag);
+    for (i = 0; i < assoc; i += 8) {
+        __m256i ways = _mm256_loadu_si256((const __m256i*) (tags + i));
+        match = (uint64_t) _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(ways, key)));
+        match = (match << i) & valid;
+        if (match)
+            return __builtin_ctzll(match);
+    }
+#elif defined(__SSE2__)
+    __m128i key = _mm_set1_epi32(tag);
+    for (i = 0; i < assoc; i += 4) {
+        __m128i ways = _mm_loadu_si128((const __m128i*) (tags + i));
+        match = (uint64_t) _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(ways, key)));
+        match = (match << i) & valid;
+        if (match)
+            return __builtin_ctzll(match);
+    }
+#else
+    for (i = 0; i < assoc; i++) {
+        match = (uint64_t) (tags[i] == tag) << i;
+        if (match & valid)
+            return i;
+    }
+#endif
+    return -1;
+}
+
+/*
+ * iplc_sim_find_way() for 16 bit tags, eight ways to a compare.
+ */
+static inline int iplc_sim_find_way16(const uint16_t *tags, uint64_t valid, uint tag, int assoc)
+{
+    uint64_t match;
+    int i;
+
+#if defined(__SSE2__)
+    __m128i key = _mm_set1_epi16((short) tag);
+    for (i = 0; i < assoc; i += 8) {
+        __m128i ways = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i*) (tags + i)), key);
+        // narrowing each lane to a byte leaves one mask bit per way
+        match = (uint64_t) (_mm_movemask_epi8(_mm_packs_epi16(ways, ways)) & 0xff);
+        match = (match << i) & valid;
+        if (match)
+            return __builtin_ctzll(match);
+    }
+#else
+    for (i = 0; i < assoc; i++) {
+        match = (uint64_t) (tags[i] == tag) << i;
+        if (match & valid)
+            return i;
+    }
+#endif
+    return -1;
+}
+
+/*
+ * The way of set index holding tag, or -1, whichever width the tags are.
+ */
+static inline int iplc_sim_cache_find(cache_t *cache, int index, uint tag)
+{
+    size_t set = (size_t) index * cache->assoc;
+
+    if (cache->tags16)
+        return iplc_sim_find_way16(&cache->tags16[set], cache->valid[index], tag, cache->assoc);
+    return iplc_sim_find_way(&cache->tags[set], cache->valid[index], tag, cache->assoc);
+}
+
+/*
+ * Make way the MRU entry of its set: every way more recent than it ages by
+ * one.  The set's ranks are padded to whole 16 byte vectors with RANK_PAD.
+ */
+static inline void iplc_sim_LRU_promote(BYTE *rank, int way, int stride)
+{
+    BYTE r = rank[way];
+    int i;
+
+    if (r == 0)
+        return;
+#if defined(__SSE2__)
+    __m128i limit = _mm_set1_epi8((char) r);
+    for (i = 0; i < stride; i += 16) {
+        __m128i ranks = _mm_loadu_si128((const __m128i*) (rank + i));
+        // younger lanes compare to all ones, subtracting -1 adds one
+        ranks = _mm_sub_epi8(ranks, _mm_cmplt_epi8(ranks, limit));
+        _mm_storeu_si128((__m128i*) (rank + i), ranks);
+    }
+#else
+    for (i = 0; i < stride; i++)
+        rank[i] += rank[i] < r;
+#endif
+    rank[way] = 0;
+}
+
+/*
+ * The way holding rank assoc - 1, the LRU entry of a full set.
+ */
+static inline int iplc_sim_LRU_victim(const BYTE *rank, int assoc, int stride)
+{
+    int i;
+
+#if defined(__SSE2__)
+    __m128i oldest = _mm_set1_epi8((char) (assoc - 1));
+    for (i = 0; i < stride; i += 16) {
+        int match = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (rank + i)),
+                                                     oldest));
+        if (match)
+            return i + __builtin_ctz(match);
+    }
+#else
+    for (i = 0; i < assoc; i++) {
+        if (rank[i] == assoc - 1)
+            return i;
+    }
+#endif
+    return 0;
+}
+
+/*
+ * Next value of the cache's xorshift generator.
+ */
+static inline uint64_t iplc_sim_random(cache_t *cache)
+{
+    uint64_t x = cache->random_state;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    cache->random_state = x;
+    return x;
+}
+
+/*
+ * Point every node on the path to way at the other half of the tree, so
+ * way is the last one the tree PLRU bits lead to.
+ */
+static inline void iplc_sim_PLRU_touch(uint64_t *bits, int way, int assoc)
+{
+    int node = 1, half = assoc;
+
+    while (half > 1) {
+        half >>= 1;
+        if (way & half) {
+            *bits &= ~(1ULL << node);
+            node = 2 * node + 1;
+        }
+        else {
+            *bits |= 1ULL << node;
+            node = 2 * node;
+        }
+    }
+}
+
+/*
+ * Follow the tree PLRU bits down to the way to replace, 1 means go right.
+ */
+static inline int iplc_sim_PLRU_victim(uint64_t bits, int assoc)
+{
+    int node = 1, half = assoc, way = 0;
+
+    while (half > 1) {
+        half >>= 1;
+        if ((bits >> node) & 1) {
+            way |= half;
+            node = 2 * node + 1;
+        }
+        else {
+            node = 2 * node;
+        }
+    }
+    return way;
+}
+
+/*
+ * Age the whole set until some way reaches RRIP_MAX and return the first
+ * such way.  Adding the gap to the oldest way at once is the same as the
+ * usual increment and rescan loop.
+ */
+static inline int iplc_sim_RRIP_victim(BYTE *rrpv, int assoc)
+{
+    BYTE oldest = 0;
+    int i;
+
+    for (i = 0; i < assoc; i++)
+        oldest = rrpv[i] > oldest ? rrpv[i] : oldest;
+    for (i = 0; i < assoc; i++)
+        rrpv[i] += RRIP_MAX - oldest;
+    for (i = 0; rrpv[i] != RRIP_MAX; i++)
+        ;
+    return i;
+}
+
+/*
+ * iplc_sim_cache_lookup() determined the entry is in our cache.  Update its
+ * replacement information.  policy is always a constant, so each caller
+ * gets its own copy with the other policies compiled out.
+ */
+static inline __attribute__((always_inline))
+void iplc_sim_update_on_hit(cache_t *cache, int index, int assoc_entry, const int policy)
+{
+    BYTE *rank = &cache->rank[(size_t) index * cache->rank_stride];
+
+    //Assoc_entry is entry index within cache[index] set that hit
+    switch (policy) {
+        case POLICY_LRU:
+            iplc_sim_LRU_promote(rank, assoc_entry, cache->rank_stride);
+            break;
+        case POLICY_PLRU:
+            iplc_sim_PLRU_touch(&cache->plru[index], assoc_entry, cache->assoc);
+            break;
+        case POLICY_SRRIP:
+        case POLICY_BRRIP:
+            rank[assoc_entry] = 0;
+            break;
+        default:
+            // FIFO and random ignore hits
+            break;
+    }
+}
+
+/*
+ * iplc_sim_cache_lookup() determined this is not in our cache.  Put it in
+ * the first empty way of the set, or in the way the policy gives up, and
+ * remember the block that was replaced.  Returns the way.
+ */
+static inline __attribute__((always_inline))
+int iplc_sim_replace_on_miss(cache_t *cache, int index, uint tag, const int policy)
+{
+    int assoc = cache->assoc;
+    uint64_t *valid = &cache->valid[index];
+    BYTE *rank = &cache->rank[(size_t) index * cache->rank_stride];
+    uint64_t full = assoc == 64 ? ~0ULL : (1ULL << assoc) - 1;
+    size_t set = (size_t) index * assoc;
+    int way;
+
+    if (*valid != full) {
+        way = __builtin_ctzll(~*valid);
+        cache->fills++;
+    }
+    else {
+        switch (policy) {
+            case POLICY_LRU:
+            case POLICY_FIFO:
+                way = iplc_sim_LRU_victim(rank, assoc, cache->rank_stride);
+                break;
+            case POLICY_PLRU:
+                way = iplc_sim_PLRU_victim(cache->plru[index], assoc);
+                break;
+            case POLICY_SRRIP:
+            case POLICY_BRRIP:
+                way = iplc_sim_RRIP_victim(rank, assoc);
+                break;
+            default:
+                way = (int) (iplc_sim_random(cache) % (uint64_t) assoc);
+                break;
+        }
+        cache->evictions++;
+        cache->evicted = TRUE;
+        cache->evicted_address = (((cache->tags16 ? cache->tags16[set + way] : cache->tags[set + way])
+                                   << cache->index) | index) << cache->blockoffsetbits;
+        cache->evicted_dirty = FALSE;
+        if (cache->dirty) {
+            cache->evicted_dirty = (cache->dirty[index] >> way) & 1;
+            cache->dirty[index] &= ~(1ULL << way);
+        }
+        if (cache->prefetch && (cache->prefetch->prefetched[index] >> way) & 1) {
+            // a prefetched block that was never used
+            cache->prefetch->prefetched[index] &= ~(1ULL << way);
+            cache->prefetch->useless++;
+        }
+    }
+
+    if (cache->tags16)
+        cache->tags16[set + way] = (uint16_t) tag;
+    else
+        cache->tags[set + way] = tag;
+    *valid |= 1ULL << way;
+
+    switch (policy) {
+        case POLICY_LRU:
+        case POLICY_FIFO:
+            // FIFO ranks by fill order, so only a fill makes a way the newest
+            iplc_sim_LRU_promote(rank, way, cache->rank_stride);
+            break;
+        case POLICY_PLRU:
+            iplc_sim_PLRU_touch(&cache->plru[index], way, assoc);
+            break;
+        case POLICY_SRRIP:
+            rank[way] = RRIP_MAX - 1;
+            break;
+        case POLICY_BRRIP:
+            rank[way] = iplc_sim_random(cache) % BRRIP_LONG ? RRIP_MAX : RRIP_MAX - 1;
+            break;
+        default:
+            break;
+    }
+    return way;
+}
+
+/*
+ * One cache lookup under a constant replacement policy.
+ */
+static inline __attribute__((always_inline))
+int iplc_sim_cache_lookup(cache_t *cache, int index, int tag, const int policy)
+{
+    int way = iplc_sim_cache_find(cache, index, tag);
+    if (way >= 0) {
+        cache->hit++;
+        iplc_sim_update_on_hit(cache, index, way, policy);
+        return 1;
+    }
+    //IF we went through the set but didnt find a match then it must be a miss
+    cache->miss++;
+    iplc_sim_replace_on_miss(cache, index, tag, policy);
+    return 0;
+}
+
+/*
+ * Look up a policy by name, -1 if there is no such policy.
+ */
+int iplc_sim_parse_policy(char *name)
+{
+    int i;
+
+    for (i = 0; i < POLICY_COUNT; i++) {
+        if (strcmp(name, policy_names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/*
+ * Access one cache level: count it, and on a miss fill the block, leaving
+ * any line it replaced in cache->evicted_address.  The lookup is a copy
+ * specialized for the level's replacement policy.
+ */
+int iplc_sim_cache_access(cache_t *cache, unsigned int address)
+{
+    uint tag = address >> (cache->blockoffsetbits + cache->index);
+    int index = (address >> cache->blockoffsetbits) & ((1 << cache->index) - 1);
+    int hit;
+
+    cache->access++;
+    cache->evicted = FALSE;
+    switch (cache->policy) {
+        case POLICY_PLRU:
+            hit = iplc_sim_cache_lookup(cache, index, tag, POLICY_PLRU);
+            break;
+        case POLICY_SRRIP:
+            hit = iplc_sim_cache_lookup(cache, index, tag, POLICY_SRRIP);
+            break;
+        case POLICY_BRRIP:
+            hit = iplc_sim_cache_lookup(cache, index, tag, POLICY_BRRIP);
+            break;
+        case POLICY_FIFO:
+            hit = iplc_sim_cache_lookup(cache, index, tag, POLICY_FIFO);
+            break;
+        case POLICY_RANDOM:
+            hit = iplc_sim_cache_lookup(cache, index, tag, POLICY_RANDOM);
+            break;
+        default:
+            hit = iplc_sim_cache_lookup(cache, index, tag, POLICY_LRU);
+            break;
+    }
+    if (cache->shadow)
+        iplc_sim_shadow_access(cache, address, hit);
+    return hit;
+}
+
+/*
+ * Exclusive lookup in a lower level: a hit is counted and the line leaves
+ * this level, since it moves up into the L1.  A miss fills nothing.
+ */
+int iplc_sim_cache_extract(cache_t *cache, unsigned int address)
+{
+    uint tag = address >> (cache->blockoffsetbits + cache->index);
+    int index = (address >> cache->blockoffsetbits) & ((1 << cache->index) - 1);
+    int way;
+
+    cache->access++;
+    way = iplc_sim_cache_find(cache, index, tag);
+    if (cache->shadow)
+        iplc_sim_shadow_access(cache, address, way >= 0);
+    if (way < 0) {
+        cache->miss++;
+        return 0;
+    }
+    cache->hit++;
+    cache->valid[index] &= ~(1ULL << way);
+    return 1;
+}
+
+/*
+ * Place a victim from the level above without counting an access.
+ */
+void iplc_sim_cache_insert(cache_t *cache, unsigned int address)
+{
+    uint tag = address >> (cache->blockoffsetbits + cache->index);
+    int index = (address >> cache->blockoffsetbits) & ((1 << cache->index) - 1);
+
+    cache->evicted = FALSE;
+    if (iplc_sim_cache_find(cache, index, tag) < 0)
+        iplc_sim_replace_on_miss(cache, index, tag, cache->policy);
+}
+
+/*
+ * Drop the block holding address if this level has it.  Returns whether
+ * the dropped block was dirty.
+ */
+int iplc_sim_cache_invalidate(cache_t *cache, unsigned int address)
+{
+    uint tag = address >> (cache->blockoffsetbits + cache->index);
+    int index = (address >> cache->blockoffsetbits) & ((1 << cache->index) - 1);
+    int way = iplc_sim_cache_find(cache, index, tag);
+    int dirty = FALSE;
+
+    if (way >= 0) {
+        cache->valid[index] &= ~(1ULL << way);
+        cache->invalidations++;
+        if (cache->dirty) {
+            dirty = (cache->dirty[index] >> way) & 1;
+            cache->dirty[index] &= ~(1ULL << way);
+        }
+        if (cache->prefetch && (cache->prefetch->prefetched[index] >> way) & 1) {
+            cache->prefetch->prefetched[index] &= ~(1ULL << way);
+            cache->prefetch->useless++;
+        }
+    }
+    return dirty;
+}
+
+/*
+ * An inclusive lower[level] evicted the block at address, remove every
+ * copy of it from the levels above.  Upper blocks are never bigger than
+ * lower ones, so the block covers whole upper blocks.  Returns whether
+ * any of the copies was dirty.
+ */
+int iplc_sim_back_invalidate(iplc_sim_t *sim, int level, unsigned int address)
+{
+    cache_t *above[2 + MAX_LOWER_LEVELS];
+    int bytes = sim->lower[level].blocksize * 4;
+    int count = 0, i, k, dirty = FALSE;
+
+    above[count++] = sim->l1i;
+    if (sim->split_l1)
+        above[count++] = sim->l1d;
+    for (i = 0; i < level; i++)
+        above[count++] = &sim->lower[i];
+
+    for (i = 0; i < count; i++) {
+        int step = above[i]->blocksize * 4;
+        for (k = 0; k < bytes / step; k++)
+            dirty |= iplc_sim_cache_invalidate(above[i], address + k * step);
+    }
+    return dirty;
+}
+
+/*
+ * Mark the block holding address dirty, if this level has it.
+ */
+void iplc_sim_cache_mark_dirty(cache_t *cache, unsigned int address)
+{
+    uint tag = address >> (cache->blockoffsetbits + cache->index);
+    int index = (address >> cache->blockoffsetbits) & ((1 << cache->index) - 1);
+    int way = iplc_sim_cache_find(cache, index, tag);
+
+    if (way >= 0)
+        cache->dirty[index] |= 1ULL << way;
+}
+
+/*
+ * A store lookup that does not allocate: a hit is counted and updates the
+ * replacement state, a miss fills nothing.
+ */
+int iplc_sim_cache_probe(cache_t *cache, unsigned int address)
+{
+    uint tag = address >> (cache->blockoffsetbits + cache->index);
+    int index = (address >> cache->blockoffsetbits) & ((1 << cache->index) - 1);
+    int way = iplc_sim_cache_find(cache, index, tag);
+
+    cache->access++;
+    if (cache->shadow)
+        iplc_sim_shadow_access(cache, address, way >= 0);
+    if (way < 0) {
+        cache->miss++;
+        return 0;
+    }
+    cache->hit++;
+    iplc_sim_update_on_hit(cache, index, way, cache->policy);
+    return 1;
+}
+
+/*
+ * Write the block at address into lower[level], or memory past the last
+ * level.  The lower levels are always write-back and write-allocate; a
+ * whole block is written so nothing has to be read first.  A dirty
+ * victim, or an inclusive victim that was dirty in a level above, goes on
+ * down the same way.
+ */
+void iplc_sim_write_below(iplc_sim_t *sim, int level, unsigned int address)
+{
+    uint tag, index;
+    int dirty;
+
+    for (; level < sim->lower_levels; level++) {
+        cache_t *cache = &sim->lower[level];
+
+        tag = address >> (cache->blockoffsetbits + cache->index);
+        index = (address >> cache->blockoffsetbits) & ((1 << cache->index) - 1);
+        cache->writes++;
+        cache->evicted = FALSE;
+        if (iplc_sim_cache_find(cache, index, tag) < 0)
+            iplc_sim_replace_on_miss(cache, index, tag, cache->policy);
+        iplc_sim_cache_mark_dirty(cache, address);
+
+        if (!cache->evicted)
+            return;
+        dirty = cache->evicted_dirty;
+        if (sim->inclusion == INCLUSION_INCLUSIVE)
+            dirty |= iplc_sim_back_invalidate(sim, level, cache->evicted_address);
+        if (!dirty)
+            return;
+        cache->writebacks++;
+        address = cache->evicted_address;
+    }
+    sim->memory_writes++;
+}
+
+/*
+ * Retire the write buffer entries that are done, then merge a store to
+ * block into an entry still waiting, if there is one.  Returns whether it
+ * merged.
+ */
+int iplc_sim_write_buffer_merge(iplc_sim_t *sim, unsigned int block)
+{
+    int i;
+
+    while (sim->write_buffer_count &&
+           sim->write_buffer_ready[sim->write_buffer_head] <= sim->pipeline_cycles) {
+        sim->write_buffer_head = (sim->write_buffer_head + 1) % sim->write_buffer_size;
+        sim->write_buffer_count--;
+    }
+    for (i = 0; i < sim->write_buffer_count; i++) {
+        if (sim->write_buffer_block[(sim->write_buffer_head + i) % sim->write_buffer_size] == block) {
+            sim->write_buffer_coalesced++;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * Queue a write that takes latency cycles in the write buffer, after
+ * iplc_sim_write_buffer_merge() found nothing to merge with.  Entries
+ * drain one at a time, in order.  Returns the cycles the store has to
+ * wait for a free entry, 0 unless the buffer is full.
+ */
+int iplc_sim_write_buffer_put(iplc_sim_t *sim, unsigned int block, int latency)
+{
+    unsigned int now = sim->pipeline_cycles;
+    int i, stall = 0;
+
+    if (sim->write_buffer_count == sim->write_buffer_size) {
+        // wait for the oldest entry to finish
+        stall = sim->write_buffer_ready[sim->write_buffer_head] - now;
+        now += stall;
+        sim->write_buffer_head = (sim->write_buffer_head + 1) % sim->write_buffer_size;
+        sim->write_buffer_count--;
+        sim->write_buffer_full++;
+        sim->write_buffer_stall_cycles += stall;
+    }
+
+    i = (sim->write_buffer_head + sim->write_buffer_count++) % sim->write_buffer_size;
+    sim->write_buffer_block[i] = block;
+    sim->write_buffer_last = (sim->write_buffer_last > now ? sim->write_buffer_last : now) + latency;
+    sim->write_buffer_ready[i] = sim->write_buffer_last;
+    return stall;
+}
+
+/*
+ * A SW reaching MEM under the write model.  Write-allocate reads the block
+ * into the L1D like a load; no-write-allocate leaves a missing block where
+ * it is.  Write-back marks the L1D line dirty, write-through (and a
+ * no-allocate miss) sends the write on below.  With a write buffer and
+ * buffered set, the store only waits for room in the buffer, otherwise it
+ * waits for the slowest of its fill and its write below.  A store merged
+ * into a waiting entry rides along with it, to memory too.  Returns
+ * whether the L1D hit, cycles is set like iplc_sim_trap_address() does.
+ */
+int iplc_sim_store(iplc_sim_t *sim, unsigned int address, int buffered, int *cycles)
+{
+    cache_t *cache = sim->l1d;
+    int write_latency = sim->lower_levels ? sim->lower[0].latency : sim->memory_latency;
+    uint block = address >> cache->blockoffsetbits;
+    int hit, below, merged;
+
+    sim->stores++;
+    if (sim->write_no_allocate) {
+        hit = iplc_sim_cache_probe(cache, address);
+        *cycles = cache->latency;
+        cache->access_cycles += *cycles;
+    }
+    else {
+        hit = iplc_sim_trap_address(sim, cache, address, cycles);
+    }
+
+    below = sim->write_through || (!hit && sim->write_no_allocate);
+    // only stores that would have to wait go through the buffer
+    merged = buffered && sim->write_buffer_size && (below || *cycles > cache->latency) &&
+             iplc_sim_write_buffer_merge(sim, block);
+    if (!below)
+        iplc_sim_cache_mark_dirty(cache, address);
+    else if (!merged)
+        iplc_sim_write_below(sim, 0, address);
+
+    if (merged) {
+        *cycles = cache->latency;
+        return hit;
+    }
+    if (below && write_latency > *cycles)
+        *cycles = write_latency;
+    if (buffered && sim->write_buffer_size && *cycles > cache->latency)
+        *cycles = cache->latency + iplc_sim_write_buffer_put(sim, block, *cycles);
+    return hit;
+}
+
+/*
+ * Give an L1 the prefetcher configured in sim.
+ */
+void iplc_sim_prefetch_init(iplc_sim_t *sim, cache_t *cache)
+{
+    prefetch_t *prefetch = (prefetch_t*) calloc(1, sizeof(prefetch_t));
+
+    prefetch->kind = sim->prefetcher;
+    prefetch->degree = sim->prefetch_degree ? sim->prefetch_degree : PREFETCH_DEGREE;
+    prefetch->latency = sim->prefetch_latency;
+    prefetch->prefetched = (uint64_t*) calloc(1 << cache->index, sizeof(uint64_t));
+    prefetch->ready = (unsigned int*) calloc((size_t) (1 << cache->index) * cache->assoc,
+                                             sizeof(unsigned int));
+    cache->prefetch = prefetch;
+}
+
+void iplc_sim_prefetch_free(cache_t *cache)
+{
+    if (cache->prefetch) {
+        free(cache->prefetch->prefetched);
+        free(cache->prefetch->ready);
+        free(cache->prefetch);
+        cache->prefetch = NULL;
+    }
+}
+
+/*
+ * The cycle a prefetch issued now is done, given how long the lower walk
+ * for it took.  Fast-forwarded prefetches are done at once.
+ */
+static inline unsigned int iplc_sim_prefetch_ready(iplc_sim_t *sim, prefetch_t *prefetch, int cycles)
+{
+    if (sim->functional)
+        return 0;
+    return sim->pipeline_cycles + (prefetch->latency ? prefetch->latency : cycles);
+}
+
+/*
+ * A demand access used a prefetched block that is done at ready.  If the
+ * prefetch is still on its way the access waits for it.
+ */
+static inline void iplc_sim_prefetch_wait(iplc_sim_t *sim, prefetch_t *prefetch, unsigned int ready,
+                                          int *cycles)
+{
+    unsigned int now = sim->pipeline_cycles;
+
+    prefetch->useful++;
+    if (ready > now) {
+        prefetch->late++;
+        prefetch->late_cycles += ready - now;
+        if (ready - now > (unsigned int) *cycles)
+            *cycles = ready - now;
+    }
+}
+
+/*
+ * Prefetch the block holding address into the L1, unless it is there
+ * already.  The fill replaces a block like a miss does, and the victim
+ * goes in the pollution filter.
+ */
+void iplc_sim_prefetch_fill(iplc_sim_t *sim, cache_t *cache, unsigned int address)
+{
+    prefetch_t *prefetch = cache->prefetch;
+    uint tag = address >> (cache->blockoffsetbits + cache->index);
+    int index = (address >> cache->blockoffsetbits) & ((1 << cache->index) - 1);
+    uint block = address >> cache->blockoffsetbits;
+    uint mask = (1 << PREFETCH_FILTER_BITS) - 1;
+    int way, dirty, cycles;
+    uint victim;
+
+    if (iplc_sim_cache_find(cache, index, tag) >= 0)
+        return;
+
+    cache->evicted = FALSE;
+    way = iplc_sim_replace_on_miss(cache, index, tag, cache->policy);
+    dirty = cache->evicted && cache->evicted_dirty;
+    victim = cache->evicted_address;
+    if (cache->evicted)
+        prefetch->filter[(victim >> cache->blockoffsetbits) & mask] = (victim >> cache->blockoffsetbits) + 1;
+    if (prefetch->filter[block & mask] == block + 1)
+        prefetch->filter[block & mask] = 0;
+
+    cycles = iplc_sim_lower_walk(sim, address);
+    iplc_sim_evict_below(sim, cache, dirty, victim);
+
+    prefetch->prefetched[index] |= 1ULL << way;
+    prefetch->ready[(size_t) index * cache->assoc + way] = iplc_sim_prefetch_ready(sim, prefetch, cycles);
+    prefetch->issued++;
+}
+
+/*
+ * A demand access hit the L1.  If a prefetch brought the block in, this
+ * is its first use: count it, and wait for the prefetch if it is not done.
+ * Returns whether it was the first use.
+ */
+int iplc_sim_prefetch_hit(iplc_sim_t *sim, cache_t *cache, unsigned int address, int *cycles)
+{
+    prefetch_t *prefetch = cache->prefetch;
+    uint tag = address >> (cache->blockoffsetbits + cache->index);
+    int index = (address >> cache->blockoffsetbits) & ((1 << cache->index) - 1);
+    int way = iplc_sim_cache_find(cache, index, tag);
+
+    if (!((prefetch->prefetched[index] >> way) & 1))
+        return FALSE;
+    prefetch->prefetched[index] &= ~(1ULL << way);
+    iplc_sim_prefetch_wait(sim, prefetch, prefetch->ready[(size_t) index * cache->assoc + way], cycles);
+    return TRUE;
+}
+
+/*
+ * A demand access missed the L1.  Check whether an earlier prefetch fill
+ * threw the block out, and look for it in the stream buffers.  A block
+ * found there moves into the L1 (the miss already made room for it) and
+ * the blocks ahead of it in its buffer are dropped.  Returns whether a
+ * stream buffer had the block, then cycles is set.
+ */
+int iplc_sim_prefetch_miss(iplc_sim_t *sim, cache_t *cache, unsigned int address, int *cycles)
+{
+    prefetch_t *prefetch = cache->prefetch;
+    uint block = address >> cache->blockoffsetbits;
+    uint *filter = &prefetch->filter[block & ((1 << PREFETCH_FILTER_BITS) - 1)];
+    int i, entry;
+
+    if (*filter == block + 1) {
+        prefetch->pollution++;
+        *filter = 0;
+    }
+
+    if (prefetch->kind == PREFETCH_STREAM) {
+        for (i = 0; i < PREFETCH_STREAMS; i++) {
+            prefetch_stream_t *stream = &prefetch->streams[i];
+            uint ahead = block - stream->first;
+
+            if (ahead >= (uint) stream->count)
+                continue;
+            entry = (stream->head + ahead) % PREFETCH_DEGREE_MAX;
+            prefetch->useless += ahead;
+            stream->head = (entry + 1) % PREFETCH_DEGREE_MAX;
+            stream->count -= ahead + 1;
+            stream->first = block + 1;
+            *cycles = cache->latency;
+            iplc_sim_prefetch_wait(sim, prefetch, stream->ready[entry], cycles);
+            return TRUE;
+        }
+    }
+    prefetch->uncovered++;
+    return FALSE;
+}
+
+/*
+ * Start the prefetches an L1 access calls for, after the access itself is
+ * served.  trigger is set for a miss or the first use of a prefetched
+ * block.  The stride table trains on every LW/SW, so it sees fetches
+ * only as accesses without a PC.
+ */
+void iplc_sim_prefetch_trigger(iplc_sim_t *sim, cache_t *cache, unsigned int address, int trigger)
+{
+    prefetch_t *prefetch = cache->prefetch;
+    uint block = address >> cache->blockoffsetbits;
+    int i, cycles;
+
+    switch (prefetch->kind) {
+        case PREFETCH_NEXTLINE:
+            if (!trigger)
+                break;
+            for (i = 1; i <= prefetch->degree; i++)
+                iplc_sim_prefetch_fill(sim, cache, (block + i) << cache->blockoffsetbits);
+            break;
+        case PREFETCH_STRIDE: {
+            prefetch_stride_t *entry;
+            int stride;
+
+            if (!sim->access_pc)
+                break;
+            entry = &prefetch->stride[(sim->access_pc >> 2) & ((1 << PREFETCH_STRIDE_BITS) - 1)];
+            if (entry->pc != sim->access_pc) {
+                entry->pc = sim->access_pc;
+                entry->last = address;
+                entry->stride = entry->confidence = 0;
+                break;
+            }
+            stride = (int) (address - entry->last);
+            if (stride == entry->stride) {
+                if (entry->confidence < 3)
+                    entry->confidence++;
+            }
+            else if (entry->confidence > 0) {
+                entry->confidence--;
+            }
+            else {
+                entry->stride = stride;
+            }
+            entry->last = address;
+            if (entry->confidence < 2 || entry->stride == 0)
+                break;
+            for (i = 1; i <= prefetch->degree; i++) {
+                uint target = address + (uint) (i * entry->stride);
+
+                if (target >> cache->blockoffsetbits != block)
+                    iplc_sim_prefetch_fill(sim, cache, target);
+            }
+            break;
+        }
+        case PREFETCH_STREAM: {
+            prefetch_stream_t *stream = NULL, *oldest = &prefetch->streams[0];
+
+            if (!trigger)
+                break;
+            // the buffer a hit came from goes on, a plain miss starts the oldest one over
+            for (i = 0; i < PREFETCH_STREAMS; i++) {
+                if (prefetch->streams[i].first == block + 1) {
+                    stream = &prefetch->streams[i];
+                    break;
+                }
+                if (prefetch->streams[i].last_use < oldest->last_use)
+                    oldest = &prefetch->streams[i];
+            }
+            if (!stream) {
+                stream = oldest;
+                prefetch->useless += stream->count;
+                stream->first = block + 1;
+                stream->count = stream->head = 0;
+            }
+            stream->last_use = ++prefetch->stream_uses;
+            while (stream->count < prefetch->degree) {
+                cycles = iplc_sim_lower_walk(sim, (stream->first + stream->count) << cache->blockoffsetbits);
+                stream->ready[(stream->head + stream->count) % PREFETCH_DEGREE_MAX] =
+                    iplc_sim_prefetch_ready(sim, prefetch, cycles);
+                stream->count++;
+                prefetch->issued++;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+/*
+ * Look up a prefetcher by name, -1 if there is no such prefetcher.
+ */
+int iplc_sim_parse_prefetcher(char *name)
+{
+    int i;
+
+    for (i = 0; i < PREFETCH_COUNT; i++) {
+        if (strcmp(name, prefetcher_names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/*
+ * Walk the levels below the L1s for a block an L1 missed, until one hits,
+ * keeping the hierarchy inclusive, exclusive or neither.  Returns the
+ * latency of the level that hit, or the memory latency.
+ */
+int iplc_sim_lower_walk(iplc_sim_t *sim, unsigned int address)
+{
+    int level, hit = 0, cycles = sim->memory_latency;
+
+    // only an L1I misses through here on a core, its L1D goes through iplc_sim_coherent_access()
+    if (sim->multicore) {
+        pthread_mutex_lock(&sim->multicore->bus);
+        cycles = iplc_sim_shared_walk(sim, address);
+        pthread_mutex_unlock(&sim->multicore->bus);
+        return cycles;
+    }
+
+    for (level = 0; level < sim->lower_levels && !hit; level++) {
+        cache_t *lower = &sim->lower[level];
+
+        if (sim->inclusion == INCLUSION_EXCLUSIVE) {
+            hit = iplc_sim_cache_extract(lower, address);
+        }
+        else {
+            hit = iplc_sim_cache_access(lower, address);
+            if (lower->evicted) {
+                int lower_dirty = lower->evicted_dirty;
+
+                if (sim->inclusion == INCLUSION_INCLUSIVE)
+                    lower_dirty |= iplc_sim_back_invalidate(sim, level, lower->evicted_address);
+                if (lower_dirty) {
+                    lower->writebacks++;
+                    iplc_sim_write_below(sim, level + 1, lower->evicted_address);
+                }
+            }
+        }
+        if (hit)
+            cycles = lower->latency;
+    }
+    if (!hit)
+        sim->memory_accesses++;
+    return cycles;
+}
+
+/*
+ * Send the block an L1 fill replaced on down once the fill is served: an
+ * exclusive hierarchy moves each level's victim one level down, and a
+ * dirty victim is written back.  dirty and victim are the L1's, taken
+ * before the lower walk.
+ */
+void iplc_sim_evict_below(iplc_sim_t *sim, cache_t *cache, int dirty, unsigned int victim)
+{
+    cache_t *upper = cache;
+    int level;
+
+    if (sim->inclusion == INCLUSION_EXCLUSIVE) {
+        for (level = 0; level < sim->lower_levels && upper->evicted; level++) {
+            iplc_sim_cache_insert(&sim->lower[level], upper->evicted_address);
+            upper = &sim->lower[level];
+        }
+    }
+
+    if (dirty) {
+        cache->writebacks++;
+        iplc_sim_write_below(sim, 0, victim);
+    }
+}
+
+/*
+ * Check if the address is in our L1 cache (sim->l1i for fetches, sim->l1d
+ * for LW/SW).  On a miss, walk the lower levels until one hits.  Returns
+ * whether the L1 hit, and in cycles how long the access took: the latency
+ * of the level that hit, or the memory latency.  With a prefetcher, a
+ * block it fetched costs what is left of that fetch, and the access may
+ * start new prefetches.
+ */
+int iplc_sim_trap_address(iplc_sim_t *sim, cache_t *cache, unsigned int address, int *cycles)
+{
+    int dirty, first_use;
+    uint victim;
+
+    if (sim->verbose >= VERBOSE_ACCESS)
+        printf("Address %x: Tag= %x, Index= %d \n", address,
+               address >> (cache->blockoffsetbits + cache->index),
+               (address >> cache->blockoffsetbits) & ((1 << cache->index) - 1));
+
+    if (iplc_sim_cache_access(cache, address)) {
+        *cycles = cache->latency;
+        if (cache->prefetch) {
+            first_use = iplc_sim_prefetch_hit(sim, cache, address, cycles);
+            iplc_sim_prefetch_trigger(sim, cache, address, first_use);
+        }
+        cache->access_cycles += *cycles;
+        return 1;
+    }
+
+    // the L1 victim is written back once the miss is served
+    dirty = cache->evicted && cache->evicted_dirty;
+    victim = cache->evicted_address;
+
+    if (!cache->prefetch || !iplc_sim_prefetch_miss(sim, cache, address, cycles))
+        *cycles = iplc_sim_lower_walk(sim, address);
+    iplc_sim_evict_below(sim, cache, dirty, victim);
+    if (cache->prefetch)
+        iplc_sim_prefetch_trigger(sim, cache, address, TRUE);
+
+    cache->access_cycles += *cycles;
+    return 0;
+}
+
+/*
+ * Finish processing all instructions in the Pipeline.
+ */
+void iplc_sim_drain(iplc_sim_t *sim)
+{
+    if (sim->issue_width) {
+        while (!iplc_sim_group_empty(sim))
+            iplc_sim_push_group(sim);
+        return;
+    }
+    // the order of the stages in the ring doesn't matter here
+    while (sim->pipeline[0].itype != NOP ||
+           sim->pipeline[1].itype != NOP ||
+           sim->pipeline[2].itype != NOP ||
+           sim->pipeline[3].itype != NOP ||
+           sim->pipeline[4].itype != NOP) {
+        iplc_sim_push_pipeline_stage(sim);
+    }
+}
+
+/*
+ * Statistics of one cache level.  The unnamed unified cache prints exactly
+ * what the original simulator did.
+ */
+void iplc_sim_cache_report(iplc_sim_t *sim, cache_t *cache)
+{
+    printf(" %s%sCache Performance \n", cache->name, cache->name[0] ? " " : "");
+    printf("\t Number of Cache Accesses is %ld \n", cache->access);
+    printf("\t Number of Cache Misses is %ld \n", cache->miss);
+    printf("\t Number of Cache Hits is %ld \n", cache->hit);
+    printf("\t Cache Miss Rate is %f \n", (double)cache->miss / (double)cache->access);
+    if (cache->shadow) {
+        printf("\t Number of Compulsory Misses is %ld \n", cache->compulsory);
+        printf("\t Number of Capacity Misses is %ld \n", cache->capacity);
+        printf("\t Number of Conflict Misses is %ld \n", cache->conflict);
+    }
+    if (cache->dirty) {
+        printf("\t Number of Blocks Written from Above is %ld \n", cache->writes);
+        printf("\t Number of Writebacks is %ld \n", cache->writebacks);
+    }
+    if (cache->prefetch) {
+        prefetch_t *prefetch = cache->prefetch;
+
+        printf("\t Number of Prefetches Issued is %ld \n", prefetch->issued);
+        printf("\t Number of Useful Prefetches is %ld \n", prefetch->useful);
+        printf("\t Number of Late Prefetches is %ld \n", prefetch->late);
+        printf("\t Number of Useless Prefetches is %ld \n", prefetch->useless);
+        printf("\t Number of Misses from Prefetch Pollution is %ld \n", prefetch->pollution);
+        printf("\t Prefetch Accuracy is %f \n",
+               prefetch->issued ? (double)prefetch->useful / (double)prefetch->issued : 0.0);
+        printf("\t Prefetch Coverage is %f \n", prefetch->useful + prefetch->uncovered ?
+               (double)prefetch->useful / (double)(prefetch->useful + prefetch->uncovered) : 0.0);
+        printf("\t Prefetch Timeliness is %f \n", prefetch->useful ?
+               (double)(prefetch->useful - prefetch->late) / (double)prefetch->useful : 0.0);
+        if (prefetch->late)
+            printf("\t Average Late Prefetch Wait is %f \n", (double)prefetch->late_cycles / (double)prefetch->late);
+    }
+    if (cache->name[0]) {
+        printf("\t Number of Back Invalidations is %ld \n", cache->invalidations);
+        if (cache->access_cycles)
+            printf("\t Average Access Time is %f \n", (double)cache->access_cycles / (double)cache->access);
+    }
+    printf("\n");
+    if (sim->report_policy) {
+        printf("%s%sReplacement Policy %s \n", cache->name, cache->name[0] ? " " : "", policy_names[cache->policy]);
+        printf("\t Number of Hits is %ld \n", cache->hit);
+        printf("\t Number of Misses is %ld \n", cache->miss);
+        printf("\t Number of Fills into empty ways is %ld \n", cache->fills);
+        printf("\t Number of Evictions is %ld \n", cache->evictions);
+        printf("\t Hit Rate is %f \n\n", (double)cache->hit / (double)cache->access);
+    }
+}
+
+/*
+ * Just output our summary statistics.
+ */
+void iplc_sim_finalize(iplc_sim_t *sim)
+{
+    int i;
+
+    iplc_sim_drain(sim);
+    if (sim->interval)
+        iplc_sim_interval_finish(sim);
+    
+    iplc_sim_cache_report(sim, sim->l1i);
+    if (sim->split_l1)
+        iplc_sim_cache_report(sim, sim->l1d);
+    for (i = 0; i < sim->lower_levels; i++)
+        iplc_sim_cache_report(sim, &sim->lower[i]);
+    if (sim->split_l1 || sim->lower_levels || sim->write_model) {
+        printf(" Memory \n\t Number of Memory Accesses is %ld \n", sim->memory_accesses);
+        if (sim->write_model)
+            printf("\t Number of Memory Writes is %ld \n", sim->memory_writes);
+        printf("\n");
+    }
+    if (sim->write_model) {
+        printf("Write Policy %s, %s \n", sim->write_through ? "write-through" : "write-back",
+               sim->write_no_allocate ? "no-write-allocate" : "write-allocate");
+        printf("\t Number of Stores is %ld \n", sim->stores);
+        if (sim->write_buffer_size) {
+            printf("\t Write Buffer Entries is %d \n", sim->write_buffer_size);
+            printf("\t Number of Coalesced Stores is %ld \n", sim->write_buffer_coalesced);
+            printf("\t Number of Stores that found the Buffer Full is %ld \n", sim->write_buffer_full);
+            printf("\t Write Buffer Stall Cycles is %lu \n", sim->write_buffer_stall_cycles);
+        }
+        printf("\n");
+    }
+    if (sim->mshrs) {
+        printf("Non-blocking Data Cache \n");
+        printf("\t MSHRs is %d \n", sim->mshrs);
+        printf("\t Number of Primary Misses is %ld \n", sim->mshr_primary);
+        printf("\t Number of Secondary Misses is %ld \n", sim->mshr_secondary);
+        printf("\t Average Outstanding Misses is %f \n",
+               sim->mshr_primary ? (double)sim->mshr_outstanding / (double)sim->mshr_primary : 0.0);
+        printf("\t Number of Misses that found the MSHRs Full is %ld \n", sim->mshr_full);
+        printf("\t MSHR Full Stall Cycles is %lu \n", sim->mshr_full_cycles);
+        printf("\t Missed Load Use Stall Cycles is %lu \n\n", sim->mshr_use_cycles);
+    }
+    if (sim->tlb_entries)
+        iplc_sim_tlb_report(sim);
+    if (sim->scoreboard) {
+        printf("Hazards, %s forwarding \n", forwarding_names[sim->forwarding]);
+        for (i = 0; i < HAZARD_COUNT; i++) {
+            printf("\t Number of %s Stalls is %ld \n", hazard_names[i], sim->hazard_stalls[i]);
+            printf("\t %s Stall Cycles is %lu \n", hazard_names[i], sim->hazard_cycles[i]);
+        }
+        printf("\n");
+    }
+    if (sim->issue_width) {
+        long groups = 0;
+
+        printf("Superscalar %d Wide, %d Stages \n", sim->issue_width, sim->pipeline_depth);
+        printf("\t Memory Ports is %d \n", sim->memory_ports);
+        printf("\t ALUs is %d \n", sim->alus);
+        for (i = 1; i <= sim->issue_width; i++) {
+            printf("\t Number of Groups of %d Retired is %ld \n", i, sim->group_retired[i]);
+            groups += sim->group_retired[i];
+        }
+        printf("\t Average Group Size is %f \n", groups ? (double)sim->instruction_count / (double)groups : 0.0);
+        for (i = 0; i < GROUP_END_COUNT; i++)
+            printf("\t Number of Groups Ended by %s is %ld \n", group_end_names[i], sim->group_ends[i]);
+        printf("\t IPC is %f \n\n", (double)sim->instruction_count / (double)sim->pipeline_cycles);
+    }
+    printf("Pipeline Performance \n");
+    printf("\t Total Cycles is %u \n", sim->pipeline_cycles);
+    printf("\t Total Instructions is %u \n", sim->instruction_count);
+    printf("\t Total Branch Instructions is %u \n", sim->branch_count);
+    printf("\t Total Correct Branch Predictions is %u \n", sim->correct_branch_predictions);
+    printf("\t CPI is %f \n\n", (double)sim->pipeline_cycles / (double)sim->instruction_count);
+    if (sim->sample_detail)
+        iplc_sim_sample_report(sim);
+    if (sim->report_predictor) {
+        unsigned int predicted = sim->correct_branch_predictions + sim->branch_mispredictions;
+
+        printf("Branch Predictor %s \n", predictor_names[sim->predictor]);
+        printf("\t Number of Predicted Branches is %u \n", predicted);
+        printf("\t Number of Mispredictions is %u \n", sim->branch_mispredictions);
+        if (sim->btb_tags)
+            printf("\t Number of BTB Misses is %u \n", sim->btb_misses);
+        printf("\t Prediction Accuracy is %f \n", predicted ? (double)sim->correct_branch_predictions / (double)predicted : 0.0);
+        printf("\t MPKI is %f \n\n", 1000.0 * (double)sim->branch_mispredictions / (double)sim->instruction_count);
+    }
+    if (sim->profile)
+        iplc_sim_profile_report(sim->profile);
+}
+
+/************************************************************************************************/
+/* TLB Functions ********************************************************************************/
+/************************************************************************************************/
+
+/*
+ * Build the TLBs from tlb_entries, tlb_assoc and the L2 TLB options, all
+ * LRU caches with one page per block.  Nothing is built without
+ * tlb_entries.  Returns -1 if a TLB's entries are not its associativity
+ * times a power of two, or the host is out of memory.
+ */
+int iplc_sim_tlb_init(iplc_sim_t *sim)
+{
+    static const char *names[TLB_COUNT] = {"ITLB", "DTLB", "L2 TLB"};
+    int entries[TLB_COUNT], assoc[TLB_COUNT];
+    int i, bits;
+
+    bzero(sim->tlb, sizeof(sim->tlb));
+    sim->walks = sim->walk_loads = sim->walk_load_misses = 0;
+    sim->walk_cycles = sim->stall_fetch_tlb = sim->stall_data_tlb = 0;
+    if (!sim->tlb_entries)
+        return 0;
+    if (!sim->page_bits)
+        sim->page_bits = PAGE_4K_BITS;
+    if (sim->walk_latency <= 0)
+        sim->walk_latency = sim->memory_latency;
+    if (sim->l2_tlb_latency <= 0)
+        sim->l2_tlb_latency = TLB_L2_LATENCY;
+
+    entries[TLB_I] = entries[TLB_D] = sim->tlb_entries;
+    assoc[TLB_I] = assoc[TLB_D] = sim->tlb_assoc;
+    entries[TLB_L2] = sim->l2_tlb_entries;
+    assoc[TLB_L2] = sim->l2_tlb_assoc;
+    for (i = 0; i < TLB_COUNT; i++) {
+        if (!entries[i])
+            continue;
+        for (bits = 0; (assoc[i] << bits) < entries[i]; bits++)
+            ;
+        if (assoc[i] << bits != entries[i]) {
+            if (sim->verbose >= VERBOSE_CONFIG)
+                printf("%s entries must be the associativity times a power of two .... \n", names[i]);
+            return -1;
+        }
+        if (!iplc_sim_cache_geometry(bits, 1 << (sim->page_bits - 2), sim->verbose >= VERBOSE_CONFIG))
+            return -1;
+        if (iplc_sim_cache_init(&sim->tlb[i], names[i], bits, 1 << (sim->page_bits - 2), assoc[i],
+                                POLICY_LRU, i == TLB_L2 ? sim->l2_tlb_latency : 0, FALSE, FALSE) < 0) {
+            if (sim->verbose >= VERBOSE_CONFIG)
+                printf("Not enough memory for the %s .... \n", names[i]);
+            return -1;
+        }
+    }
+
+    if (sim->verbose >= VERBOSE_CONFIG) {
+        printf("TLBs \n");
+        printf("   Pages: %s \n", sim->page_bits == PAGE_2M_BITS ? "2M" : "4K");
+        printf("   L1 TLBs: %d entries, %d-way \n", sim->tlb_entries, sim->tlb_assoc);
+        if (sim->l2_tlb_entries)
+            printf("   L2 TLB: %d entries, %d-way, latency %d \n", sim->l2_tlb_entries,
+                   sim->l2_tlb_assoc, sim->l2_tlb_latency);
+        if (sim->walk_through_cache)
+            printf("   PageWalk: through the L1D \n");
+        else
+            printf("   PageWalk: %d cycles per level \n", sim->walk_latency);
+    }
+    return 0;
+}
+
+/*
+ * Release the TLBs.
+ */
+void iplc_sim_tlb_free(iplc_sim_t *sim)
+{
+    int i;
+
+    for (i = 0; i < TLB_COUNT; i++)
+        iplc_sim_cache_free(&sim->tlb[i]);
+}
+
+/*
+ * The page walk resolves 9 bits of the virtual page number per level, so
+ * the 48 bit virtual addresses of x86-64 take four levels with 4K pages
+ * and three with 2M pages.  The trace's 32 bit addresses only ever use the
+ * first entry of the top levels.
+ */
+static inline int iplc_sim_page_levels(iplc_sim_t *sim)
+{
+    return sim->page_bits == PAGE_2M_BITS ? 3 : 4;
+}
+
+/*
+ * Where the page table entry for address is at level (0 is the root).
+ * The tables of each level are packed in the order of the page numbers
+ * they map, so neighbouring pages share a block of entries like they do
+ * in a real page table.
+ */
+unsigned int iplc_sim_pte_address(iplc_sim_t *sim, unsigned int address, int level)
+{
+    unsigned int vpn = address >> sim->page_bits;
+    int shift = PAGE_LEVEL_BITS * (iplc_sim_page_levels(sim) - 1 - level);
+
+    return PAGE_TABLE_BASE + level * PAGE_TABLE_SPAN + (vpn >> shift) * 8;
+}
+
+/*
+ * Walk the page table for address after a miss in every TLB.  Returns the
+ * cycles the walk takes: walk_latency per level, or with
+ * walk_through_cache what the L1D and the levels below charge for each
+ * entry.  The entry loads are not LW/SW the stride prefetcher learns from.
+ */
+int iplc_sim_page_walk(iplc_sim_t *sim, unsigned int address)
+{
+    int levels = iplc_sim_page_levels(sim);
+    unsigned int pc = sim->access_pc;
+    int level, cycles = 0, load_cycles;
+
+    sim->walks++;
+    if (!sim->walk_through_cache) {
+        cycles = levels * sim->walk_latency;
+    }
+    else {
+        sim->access_pc = 0;
+        for (level = 0; level < levels; level++) {
+            sim->walk_loads++;
+            if (!iplc_sim_trap_address(sim, sim->l1d, iplc_sim_pte_address(sim, address, level), &load_cycles))
+                sim->walk_load_misses++;
+            cycles += load_cycles;
+        }
+        sim->access_pc = pc;
+    }
+    sim->walk_cycles += cycles;
+    return cycles;
+}
+
+/*
+ * Translate address through the L1 TLB kind (TLB_I or TLB_D), then the L2
+ * TLB and then the page table, filling each TLB that missed.  Returns the
+ * cycles the translation adds to the access.  An L1 TLB hit adds none, it
+ * overlaps the L1 lookup.
+ */
+int iplc_sim_translate(iplc_sim_t *sim, int kind, unsigned int address)
+{
+    cache_t *l2 = &sim->tlb[TLB_L2];
+    int cycles = 0;
+
+    if (iplc_sim_cache_access(&sim->tlb[kind], address))
+        return 0;
+    if (l2->assoc) {
+        cycles = l2->latency;
+        if (iplc_sim_cache_access(l2, address))
+            return cycles;
+    }
+    if (sim->verbose >= VERBOSE_ACCESS)
+        printf("PAGE WALK: ADDRESS 0x%x \n", address);
+    return cycles + iplc_sim_page_walk(sim, address);
+}
+
+/*
+ * Statistics of the TLBs and the page walks.
+ */
+void iplc_sim_tlb_report(iplc_sim_t *sim)
+{
+    int i;
+
+    for (i = 0; i < TLB_COUNT; i++) {
+        cache_t *tlb = &sim->tlb[i];
+
+        if (!tlb->assoc)
+            continue;
+        printf(" %s Performance \n", tlb->name);
+        printf("\t Number of TLB Accesses is %ld \n", tlb->access);
+        printf("\t Number of TLB Misses is %ld \n", tlb->miss);
+        printf("\t TLB Miss Rate is %f \n", tlb->access ? (double)tlb->miss / (double)tlb->access : 0.0);
+        printf("\t TLB Reach is %lu KB \n\n",
+               ((unsigned long) tlb->assoc << tlb->index << sim->page_bits) >> 10);
+    }
+    printf("Page Walks, %s Pages, %d Levels \n", sim->page_bits == PAGE_2M_BITS ? "2M" : "4K",
+           iplc_sim_page_levels(sim));
+    printf("\t Number of Page Walks is %ld \n", sim->walks);
+    printf("\t Average Page Walk Cycles is %f \n",
+           sim->walks ? (double)sim->walk_cycles / (double)sim->walks : 0.0);
+    if (sim->walk_through_cache) {
+        printf("\t Number of Page Table Loads is %ld \n", sim->walk_loads);
+        printf("\t Number of Page Table Loads that Missed the L1D is %ld \n", sim->walk_load_misses);
+    }
+    printf("\t Fetch Translation Stall Cycles is %lu \n", sim->stall_fetch_tlb);
+    printf("\t Data Translation Stall Cycles is %lu \n\n", sim->stall_data_tlb);
+}
+
+/************************************************************************************************/
+/* Branch Prediction Functions ******************************************************************/
+/************************************************************************************************/
+
+/*
+ * Look up a predictor by name, -1 if there is no such predictor.
+ */
+int iplc_sim_parse_predictor(char *name)
+{
+    int i;
+
+    for (i = 0; i < PREDICT_COUNT; i++) {
+        if (strcmp(name, predictor_names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/*
+ * Allocate the tables of the configured predictor and BTB.  Counters start
+ * weakly not taken and the chooser weakly prefers the bimodal side.
+ */
+int iplc_sim_predictor_init(iplc_sim_t *sim)
+{
+    size_t entries;
+
+    sim->bimodal_table = sim->gshare_table = sim->chooser_table = NULL;
+    sim->btb_tags = sim->btb_targets = NULL;
+    sim->branch_history = 0;
+    sim->branch_mispredictions = sim->btb_misses = 0;
+
+    if (sim->predictor_bits <= 0)
+        sim->predictor_bits = PREDICT_TABLE_BITS;
+    if (sim->history_bits <= 0 || sim->history_bits > sim->predictor_bits)
+        sim->history_bits = sim->predictor_bits;
+    if (sim->predictor_bits > 24 || sim->btb_bits < 0 || sim->btb_bits > 24) {
+        if (sim->verbose >= VERBOSE_CONFIG)
+            printf("Predictor and BTB tables are limited to 2^24 entries .... \n");
+        return -1;
+    }
+
+    entries = (size_t) 1 << sim->predictor_bits;
+    if (sim->predictor == PREDICT_BIMODAL || sim->predictor == PREDICT_TOURNAMENT) {
+        sim->bimodal_table = (BYTE*) malloc(entries);
+        memset(sim->bimodal_table, 1, entries);
+    }
+    if (sim->predictor == PREDICT_GSHARE || sim->predictor == PREDICT_TOURNAMENT) {
+        sim->gshare_table = (BYTE*) malloc(entries);
+        memset(sim->gshare_table, 1, entries);
+    }
+    if (sim->predictor == PREDICT_TOURNAMENT) {
+        sim->chooser_table = (BYTE*) malloc(entries);
+        memset(sim->chooser_table, 1, entries);
+    }
+    if (sim->btb_bits) {
+        sim->btb_tags = (uint*) calloc((size_t) 1 << sim->btb_bits, sizeof(uint));
+        sim->btb_targets = (uint*) calloc((size_t) 1 << sim->btb_bits, sizeof(uint));
+    }
+
+    if (sim->verbose >= VERBOSE_CONFIG && (sim->predictor != PREDICT_STATIC || sim->btb_bits)) {
+        printf("Branch Predictor Configuration \n");
+        printf("   Predictor: %s \n", predictor_names[sim->predictor]);
+        if (sim->predictor != PREDICT_STATIC)
+            printf("   TableEntries: %d \n", 1 << sim->predictor_bits);
+        if (sim->predictor == PREDICT_GSHARE || sim->predictor == PREDICT_TOURNAMENT)
+            printf("   HistoryBits: %d \n", sim->history_bits);
+        printf("   BTBEntries: %d \n", sim->btb_bits ? 1 << sim->btb_bits : 0);
+    }
+    return 0;
+}
+
+void iplc_sim_predictor_free(iplc_sim_t *sim)
+{
+    free(sim->bimodal_table);
+    free(sim->gshare_table);
+    free(sim->chooser_table);
+    free(sim->btb_tags);
+    free(sim->btb_targets);
+    sim->bimodal_table = sim->gshare_table = sim->chooser_table = NULL;
+    sim->btb_tags = sim->btb_targets = NULL;
+}
+
+/*
+ * Saturating 2 bit counter update, 2 and 3 predict taken.
+ */
+static inline void iplc_sim_counter_update(BYTE *counter, int taken)
+{
+    if (taken && *counter < 3)
+        (*counter)++;
+    else if (!taken && *counter > 0)
+        (*counter)--;
+}
+
+static inline uint iplc_sim_bimodal_index(iplc_sim_t *sim, unsigned int address)
+{
+    return (address >> 2) & ((1U << sim->predictor_bits) - 1);
+}
+
+static inline uint iplc_sim_gshare_index(iplc_sim_t *sim, unsigned int address)
+{
+    return ((address >> 2) ^ sim->branch_history) & ((1U << sim->predictor_bits) - 1);
+}
+
+/*
+ * Predicted direction of the branch at address.
+ */
+int iplc_sim_predict(iplc_sim_t *sim, unsigned int address)
+{
+    int bimodal, gshare;
+
+    switch (sim->predictor) {
+        case PREDICT_BIMODAL:
+            return sim->bimodal_table[iplc_sim_bimodal_index(sim, address)] >= 2;
+        case PREDICT_GSHARE:
+            return sim->gshare_table[iplc_sim_gshare_index(sim, address)] >= 2;
+        case PREDICT_TOURNAMENT:
+            bimodal = sim->bimodal_table[iplc_sim_bimodal_index(sim, address)] >= 2;
+            gshare = sim->gshare_table[iplc_sim_gshare_index(sim, address)] >= 2;
+            return sim->chooser_table[iplc_sim_bimodal_index(sim, address)] >= 2 ? gshare : bimodal;
+        default:
+            return sim->branch_predict_taken;
+    }
+}
+
+/*
+ * Train the predictor with the resolved direction of the branch at address.
+ */
+void iplc_sim_predictor_update(iplc_sim_t *sim, unsigned int address, int taken)
+{
+    uint b = iplc_sim_bimodal_index(sim, address);
+    uint g = iplc_sim_gshare_index(sim, address);
+
+    if (sim->predictor == PREDICT_TOURNAMENT) {
+        int bimodal_right = (sim->bimodal_table[b] >= 2) == taken;
+        int gshare_right = (sim->gshare_table[g] >= 2) == taken;
+
+        // the chooser only learns when the two sides disagree
+        if (bimodal_right != gshare_right)
+            iplc_sim_counter_update(&sim->chooser_table[b], gshare_right);
+    }
+    if (sim->bimodal_table)
+        iplc_sim_counter_update(&sim->bimodal_table[b], taken);
+    if (sim->gshare_table) {
+        iplc_sim_counter_update(&sim->gshare_table[g], taken);
+        sim->branch_history = ((sim->branch_history << 1) | taken) & ((1U << sim->history_bits) - 1);
+    }
+}
+
+/*
+ * Direct mapped BTB lookup.  Returns whether address has an entry and its
+ * target.  A tag of 0 marks an empty entry, no instruction lives at 0.
+ */
+int iplc_sim_btb_lookup(iplc_sim_t *sim, unsigned int address, unsigned int *target)
+{
+    uint entry = (address >> 2) & ((1U << sim->btb_bits) - 1);
+
+    if (sim->btb_tags[entry] != address)
+        return 0;
+    *target = sim->btb_targets[entry];
+    return 1;
+}
+
+void iplc_sim_btb_update(iplc_sim_t *sim, unsigned int address, unsigned int target)
+{
+    uint entry = (address >> 2) & ((1U << sim->btb_bits) - 1);
+
+    sim->btb_tags[entry] = address;
+    sim->btb_targets[entry] = target;
+}
+
+/*
+ * Predict the branch at DECODE against what was actually fetched after
+ * it.  A predicted taken branch only redirects fetch if the BTB has its
+ * target, so a BTB miss or a stale target is a misprediction too.  Returns
+ * whether the prediction was right.
+ */
+int iplc_sim_branch_resolve(iplc_sim_t *sim, unsigned int address, unsigned int next_address)
+{
+    int taken = (address + 4) != next_address;
+    int predicted = iplc_sim_predict(sim, address);
+    int correct = predicted == taken;
+    unsigned int target = 0;
+
+    if (sim->btb_tags) {
+        if (!iplc_sim_btb_lookup(sim, address, &target)) {
+            sim->btb_misses++;
+            if (predicted)
+                correct = !taken;
+        }
+        else if (predicted && taken && target != next_address) {
+            correct = FALSE;
+        }
+        if (taken)
+            iplc_sim_btb_update(sim, address, next_address);
+    }
+    if (sim->predictor != PREDICT_STATIC)
+        iplc_sim_predictor_update(sim, address, taken);
+    return correct;
+}
+
+/************************************************************************************************/
+/* Interval Functions ***************************************************************************/
+/************************************************************************************************/
+
+/*
+ * Start the interval CSV.  Rows are written as each interval retires, so
+ * the file can be followed while a long trace runs.
+ */
+void iplc_sim_interval_init(iplc_sim_t *sim)
+{
+    bzero(&sim->interval_last, sizeof(interval_stats_t));
+    sim->interval_index = 0;
+    sim->interval_next = sim->interval;
+    if (sim->interval_file == NULL)
+        sim->interval_file = stdout;
+    fprintf(sim->interval_file, "interval,instructions,end_instruction,cycles,cpi,fetch_accesses,fetch_miss_rate,"
+            "data_accesses,data_miss_rate,branches,branch_accuracy,fetch_stall_cycles,"
+            "data_stall_cycles,branch_stall_cycles,load_use_stall_cycles\n");
+}
+
+void iplc_sim_interval_snapshot(iplc_sim_t *sim, interval_stats_t *stats)
+{
+    stats->instructions = sim->instruction_count;
+    stats->cycles = sim->pipeline_cycles;
+    stats->fetch_accesses = sim->fetch_accesses;
+    stats->fetch_misses = sim->fetch_misses;
+    stats->data_accesses = sim->data_accesses;
+    stats->data_misses = sim->data_misses;
+    stats->correct_branches = sim->correct_branch_predictions;
+    stats->mispredicted_branches = sim->branch_mispredictions;
+    stats->stall_fetch = sim->stall_fetch;
+    stats->stall_data = sim->stall_data;
+    stats->stall_branch = sim->stall_branch;
+    stats->stall_load_use = sim->stall_load_use;
+}
+
+/*
+ * Write one CSV row covering everything since the previous row.  Every
+ * column counts this interval only, except end_instruction, the retired
+ * instructions so far.
+ */
+void iplc_sim_interval_emit(iplc_sim_t *sim)
+{
+    interval_stats_t now, *last = &sim->interval_last;
+    unsigned int instructions, cycles, branches;
+    long fetches, datas;
+
+    iplc_sim_interval_snapshot(sim, &now);
+    instructions = now.instructions - last->instructions;
+    cycles = now.cycles - last->cycles;
+    fetches = now.fetch_accesses - last->fetch_accesses;
+    datas = now.data_accesses - last->data_accesses;
+    branches = (now.correct_branches - last->correct_branches) +
+               (now.mispredicted_branches - last->mispredicted_branches);
+
+    fprintf(sim->interval_file, "%d,%u,%u,%u,%f,%ld,%f,%ld,%f,%u,%f,%lu,%lu,%lu,%lu\n",
+            sim->interval_index, instructions, now.instructions, cycles,
+            instructions ? (double)cycles / (double)instructions : 0.0,
+            fetches, fetches ? (double)(now.fetch_misses - last->fetch_misses) / (double)fetches : 0.0,
+            datas, datas ? (double)(now.data_misses - last->data_misses) / (double)datas : 0.0,
+            branches, branches ? (double)(now.correct_branches - last->correct_branches) / (double)branches : 0.0,
+            now.stall_fetch - last->stall_fetch, now.stall_data - last->stall_data,
+            now.stall_branch - last->stall_branch, now.stall_load_use - last->stall_load_use);
+
+    *last = now;
+    sim->interval_index++;
+    sim->interval_next += sim->interval;
+}
+
+/*
+ * Write the last, partial interval and flush the CSV.
+ */
+void iplc_sim_interval_finish(iplc_sim_t *sim)
+{
+    if (sim->instruction_count != sim->interval_last.instructions)
+        iplc_sim_interval_emit(sim);
+    fflush(sim->interval_file);
+}
+
+/************************************************************************************************/
+/* Sampling Functions ***************************************************************************/
+/************************************************************************************************/
+
+/*
+ * Two sided 95% Student t values for 1 to 30 degrees of freedom, 1.96
+ * past that.
+ */
+const double sample_t95[30] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                               2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                               2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+
+/*
+ * Fast-forward one instruction: the TLBs, the L1s (and the levels below)
+ * and the branch predictor see it, the pipeline and its timing do not.
+ * A branch is resolved when the instruction after it arrives.
+ */
+void iplc_sim_functional_instruction(iplc_sim_t *sim, iplc_inst_t *inst)
+{
+    int cycles;
+
+    if (sim->functional_branch) {
+        // counted like the pipeline does, so branch statistics cover the whole trace
+        sim->branch_count++;
+        if (iplc_sim_branch_resolve(sim, sim->functional_branch, inst->instruction_address))
+            sim->correct_branch_predictions++;
+        else
+            sim->branch_mispredictions++;
+        sim->functional_branch = 0;
+    }
+
+    sim->functional = TRUE;
+    sim->access_pc = 0;
+    if (sim->tlb_entries)
+        iplc_sim_translate(sim, TLB_I, inst->instruction_address);
+    iplc_sim_trap_address(sim, sim->l1i, inst->instruction_address, &cycles);
+    sim->access_pc = inst->instruction_address;
+    if (sim->tlb_entries && (inst->op == OP_LW || inst->op == OP_SW))
+        iplc_sim_translate(sim, TLB_D, inst->data_address);
+    if (inst->op == OP_SW && sim->write_model)
+        iplc_sim_store(sim, inst->data_address, FALSE, &cycles);
+    else if (inst->op == OP_LW || inst->op == OP_SW)
+        iplc_sim_trap_address(sim, sim->l1d, inst->data_address, &cycles);
+    else if (inst->op == OP_BEQ)
+        sim->functional_branch = inst->instruction_address;
+    sim->functional = FALSE;
+}
+
+/*
+ * Place the next instruction in the sampling period: fast-forward, then
+ * warmup, then the detailed window.  Returns TRUE if it should go through
+ * the pipeline.  A detailed window is measured from its first instruction
+ * to the first one after it, then the pipeline is drained before the next
+ * fast-forward.
+ */
+int iplc_sim_sample_step(iplc_sim_t *sim)
+{
+    unsigned int detail_start = sim->sample_ff + sim->sample_warmup;
+    unsigned int period = detail_start + sim->sample_detail;
+
+    if (sim->sample_position == period) {
+        double cpi = (double) (sim->pipeline_cycles - sim->sample_start_cycles) / sim->sample_detail;
+
+        sim->sample_count++;
+        sim->sample_sum += cpi;
+        sim->sample_sum_squares += cpi * cpi;
+        iplc_sim_drain(sim);
+        sim->sample_position = 0;
+    }
+    if (sim->sample_position == detail_start)
+        sim->sample_start_cycles = sim->pipeline_cycles;
+
+    sim->sample_instructions++;
+    return sim->sample_position++ >= sim->sample_ff;
+}
+
+/*
+ * Mean CPI of the detailed windows, and the half width of its 95%
+ * confidence interval (0 with fewer than two windows).
+ */
+double iplc_sim_sample_cpi(iplc_sim_t *sim, double *half_width)
+{
+    double mean, variance;
+    long n = sim->sample_count;
+
+    *half_width = 0.0;
+    if (n == 0)
+        return 0.0;
+    mean = sim->sample_sum / n;
+    if (n > 1) {
+        variance = (sim->sample_sum_squares - n * mean * mean) / (n - 1);
+        if (variance < 0.0)
+            variance = 0.0;
+        *half_width = (n - 1 <= 30 ? sample_t95[n - 2] : 1.96) * sqrt(variance / n);
+    }
+    return mean;
+}
+
+void iplc_sim_sample_report(iplc_sim_t *sim)
+{
+    double half_width;
+    double cpi = iplc_sim_sample_cpi(sim, &half_width);
+    unsigned long detailed = (unsigned long) sim->sample_count * sim->sample_detail;
+
+    printf("Sampled Simulation \n");
+    printf("\t Fast-forward, Warmup, Detailed is %u, %u, %u instructions \n",
+           sim->sample_ff, sim->sample_warmup, sim->sample_detail);
+    printf("\t Number of Detailed Windows is %ld \n", sim->sample_count);
+    printf("\t Total Instructions is %lu \n", sim->sample_instructions);
+    printf("\t Detailed Instructions is %lu (%f of the trace) \n", detailed,
+           sim->sample_instructions ? (double)detailed / (double)sim->sample_instructions : 0.0);
+    printf("\t Sampled CPI is %f \n", cpi);
+    printf("\t CPI 95%% Confidence Interval is %f to %f (+/- %f%%) \n", cpi - half_width, cpi + half_width,
+           cpi ? 100.0 * half_width / cpi : 0.0);
+    printf("\t Estimated Total Cycles is %.0f \n\n", cpi * sim->sample_instructions);
+}
+
+/************************************************************************************************/
+/* Profile Functions ****************************************************************************/
+/************************************************************************************************/
+
+/*
+ * Start a profile of top hotspots, written to the flat file name as well
+ * if it is not NULL.
+ */
+profile_t *iplc_sim_profile_open(int top, char *name, int block_bits)
+{
+    profile_t *profile = (profile_t*) calloc(1, sizeof(profile_t));
+    profile_table_t *tables[2] = {&profile->pcs, &profile->blocks};
+    int i;
+
+    if (name && (profile->file = fopen(name, "w")) == NULL) {
+        printf("fopen failed for %s file\n", name);
+        exit(-1);
+    }
+    for (i = 0; i < 2; i++) {
+        tables[i]->mask = (1 << PROFILE_MIN_BITS) - 1;
+        tables[i]->shift = 32 - PROFILE_MIN_BITS;
+        tables[i]->slots = (profile_entry_t*) calloc(1 << PROFILE_MIN_BITS, sizeof(profile_entry_t));
+    }
+    profile->top = top;
+    profile->block_bits = block_bits;
+    return profile;
+}
+
+/*
+ * The entry of address, added to the table if it is new.
+ */
+profile_entry_t *iplc_sim_profile_entry(profile_table_t *table, uint address)
+{
+    uint i;
+
+    if (2 * (table->count + 1) > (long) table->mask + 1) {
+        profile_entry_t *old = table->slots;
+        uint old_size = table->mask + 1;
+
+        table->mask = 2 * old_size - 1;
+        table->shift--;
+        table->slots = (profile_entry_t*) calloc(2 * old_size, sizeof(profile_entry_t));
+        for (i = 0; i < old_size; i++) {
+            if (old[i].address) {
+                uint j = (old[i].address * 0x9e3779b9u) >> table->shift;
+
+                while (table->slots[j].address)
+                    j = (j + 1) & table->mask;
+                table->slots[j] = old[i];
+            }
+        }
+        free(old);
+    }
+
+    address++;
+    for (i = (address * 0x9e3779b9u) >> table->shift; table->slots[i].address; i = (i + 1) & table->mask) {
+        if (table->slots[i].address == address)
+            return &table->slots[i];
+    }
+    table->slots[i].address = address;
+    table->count++;
+    return &table->slots[i];
+}
+
+static inline void iplc_sim_profile_stall(profile_t *profile, uint pc, unsigned int cycles)
+{
+    iplc_sim_profile_entry(&profile->pcs, pc)->stall_cycles += cycles;
+}
+
+/*
+ * Charge the L1D access of the LW/SW in MEM, which cost data_cycles, to
+ * both its PC and its block.
+ */
+static inline void iplc_sim_profile_data(profile_t *profile, pipeline_t *mem, int data_hit, int data_cycles)
+{
+    profile_entry_t *pc = iplc_sim_profile_entry(&profile->pcs, mem->instruction_address);
+    profile_entry_t *block = iplc_sim_profile_entry(&profile->blocks, mem->data_address >> profile->block_bits);
+    unsigned int stall = data_cycles > 1 ? data_cycles - 1 : 0;
+
+    pc->stall_cycles += stall;
+    block->stall_cycles += stall;
+    block->executions++;
+    if (!data_hit) {
+        pc->data_misses++;
+        pc->last_miss = mem->data_address;
+        block->data_misses++;
+        block->last_miss = mem->instruction_address;
+    }
+}
+
+/*
+ * Most stall cycles first, then most misses, then lowest address.
+ */
+int iplc_sim_profile_compare(const void *a, const void *b)
+{
+    const profile_entry_t *x = (const profile_entry_t*) a, *y = (const profile_entry_t*) b;
+    uint x_misses = x->fetch_misses + x->data_misses, y_misses = y->fetch_misses + y->data_misses;
+
+    if (x->stall_cycles != y->stall_cycles)
+        return x->stall_cycles < y->stall_cycles ? 1 : -1;
+    if (x_misses != y_misses)
+        return x_misses < y_misses ? 1 : -1;
+    return x->address < y->address ? -1 : x->address > y->address;
+}
+
+int iplc_sim_profile_address_compare(const void *a, const void *b)
+{
+    const profile_entry_t *x = (const profile_entry_t*) a, *y = (const profile_entry_t*) b;
+
+    return x->address < y->address ? -1 : x->address > y->address;
+}
+
+/*
+ * A sorted copy of the entries in use, table->count of them.
+ */
+profile_entry_t *iplc_sim_profile_sorted(profile_table_t *table,
+                                         int (*compare)(const void*, const void*))
+{
+    profile_entry_t *sorted = (profile_entry_t*) malloc((table->count + 1) * sizeof(profile_entry_t));
+    long count = 0;
+    uint i;
+
+    for (i = 0; i <= table->mask; i++) {
+        if (table->slots[i].address)
+            sorted[count++] = table->slots[i];
+    }
+    qsort(sorted, count, sizeof(profile_entry_t), compare);
+    return sorted;
+}
+
+/*
+ * The instructions with the most stall cycles, and the data blocks whose
+ * misses cost the most.
+ */
+void iplc_sim_profile_report(profile_t *profile)
+{
+    profile_entry_t *top = iplc_sim_profile_sorted(&profile->pcs, iplc_sim_profile_compare);
+    unsigned long stalls = 0;
+    long i;
+
+    for (i = 0; i < profile->pcs.count; i++)
+        stalls += top[i].stall_cycles;
+    printf("Hotspots, top %d of %ld Instructions \n", profile->top, profile->pcs.count);
+    printf("\t Attributed Stall Cycles is %lu \n", stalls);
+    for (i = 0; i < profile->pcs.count && i < profile->top; i++) {
+        printf("\t PC 0x%x: %lu Stall Cycles, %u Executions, %u I-Cache Misses, %u D-Cache Misses, "
+               "%u Mispredictions \n", top[i].address - 1, top[i].stall_cycles, top[i].executions,
+               top[i].fetch_misses, top[i].data_misses, top[i].mispredictions);
+    }
+    printf("\n");
+    free(top);
+
+    top = iplc_sim_profile_sorted(&profile->blocks, iplc_sim_profile_compare);
+    printf("Data Hotspots, top %d of %ld Blocks \n", profile->top, profile->blocks.count);
+    for (i = 0; i < profile->blocks.count && i < profile->top; i++) {
+        printf("\t Block 0x%x: %lu Stall Cycles, %u Accesses, %u D-Cache Misses, Last Missed by PC 0x%x \n",
+               (top[i].address - 1) << profile->block_bits, top[i].stall_cycles, top[i].executions,
+               top[i].data_misses, top[i].last_miss);
+    }
+    if (profile->blocks.count == 0)
+        printf("\t No LW or SW ran \n");
+    printf("\n");
+    free(top);
+}
+
+/*
+ * Write the flat file, one line per PC in address order so it lines up
+ * with a disassembly, and free the profile.
+ */
+void iplc_sim_profile_close(profile_t *profile)
+{
+    profile_entry_t *all;
+    long i;
+
+    if (profile->file) {
+        all = iplc_sim_profile_sorted(&profile->pcs, iplc_sim_profile_address_compare);
+        fprintf(profile->file, "# pc executions icache_misses dcache_misses mispredictions "
+                               "stall_cycles last_miss_address\n");
+        for (i = 0; i < profile->pcs.count; i++) {
+            fprintf(profile->file, "%08x %u %u %u %u %lu %08x\n", all[i].address - 1, all[i].executions,
+                    all[i].fetch_misses, all[i].data_misses, all[i].mispredictions, all[i].stall_cycles,
+                    all[i].last_miss);
+        }
+        fclose(profile->file);
+        free(all);
+    }
+    free(profile->pcs.slots);
+    free(profile->blocks.slots);
+    free(profile);
+}
+
+/************************************************************************************************/
+/* Pipeline Functions ***************************************************************************/
+/************************************************************************************************/
+
+/*
+ * The entry currently in the given stage of the pipeline ring.
+ */
+static inline pipeline_t *iplc_sim_stage(iplc_sim_t *sim, int stage)
+{
+    int slot = sim->pipeline_head + stage;
+
+    return &sim->pipeline[slot < MAX_STAGES ? slot : slot - MAX_STAGES];
+}
+
+/*
+ * The group currently in the given stage of the superscalar ring.  The
+ * last four stages are DECODE, ALU, MEM and WRITEBACK, the first is FETCH
+ * and any others fetch too.
+ */
+static inline pipeline_group_t *iplc_sim_group(iplc_sim_t *sim, int stage)
+{
+    int slot = sim->pipeline_head + stage;
+
+    return &sim->group[slot < sim->pipeline_depth ? slot : slot - sim->pipeline_depth];
+}
+
+/*
+ * Dump the current contents of our pipeline.
+ */
+void iplc_sim_dump_pipeline(iplc_sim_t *sim)
+{
+    int i;    
+    
+    if (sim->issue_width) {
+        const char *names[MAX_STAGES] = {"FETCH", "DECODE", "ALU", "MEM", "WB"};
+        int back = sim->pipeline_depth - MAX_STAGES, j;
+
+        printf("(cyc: %u)", sim->pipeline_cycles);
+        for (i = 0; i < sim->pipeline_depth; i++) {
+            pipeline_group_t *group = iplc_sim_group(sim, i);
+
+            if (i == 0 || i > back)
+                printf(" %s:", names[i ? i - back : FETCH]);
+            else
+                printf(" FETCH%d:", i + 1);
+            for (j = 0; j < group->count; j++)
+                printf(" %d: 0x%x", group->slot[j].itype, group->slot[j].instruction_address);
+            printf(" \t");
+        }
+        printf("\n");
+        return;
+    }
+    for (i = 0; i < MAX_STAGES; i++) {
+        pipeline_t *stage = iplc_sim_stage(sim, i);
+
+        switch(i) {
+            case FETCH:
+                printf("(cyc: %u) FETCH:\t %d: 0x%x \t", sim->pipeline_cycles, stage->itype, stage->instruction_address);
+                break;
+            case DECODE:
+                printf("DECODE:\t %d: 0x%x \t", stage->itype, stage->instruction_address);
+                break;
+            case ALU:
+                printf("ALU:\t %d: 0x%x \t", stage->itype, stage->instruction_address);
+                break;
+            case MEM:
+                printf("MEM:\t %d: 0x%x \t", stage->itype, stage->instruction_address);
+                break;
+            case WRITEBACK:
+                printf("WB:\t %d: 0x%x \n", stage->itype, stage->instruction_address);
+                break;
+            default:
+                printf("DUMP: Bad stage!\n" );
+                exit(-1);
+        }
+    }
+}
+
+/*
+ * The MSHR waiting for block, or -1.  Entries whose fill is done by now
+ * are retired first.
+ */
+int iplc_sim_mshr_find(iplc_sim_t *sim, unsigned int block)
+{
+    int i, found = -1;
+
+    for (i = 0; i < sim->mshr_count; i++) {
+        if (sim->mshr_ready[i] <= sim->pipeline_cycles) {
+            // the last entry takes the retired one's place
+            sim->mshr_count--;
+            sim->mshr_block[i] = sim->mshr_block[sim->mshr_count];
+            sim->mshr_ready[i] = sim->mshr_ready[sim->mshr_count];
+            i--;
+        }
+        else if (sim->mshr_block[i] == block) {
+            found = i;
+        }
+    }
+    return found;
+}
+
+/*
+ * A LW/SW in MEM under the non-blocking data cache.  A miss takes an MSHR
+ * and the pipeline goes on while the block is fetched; only when every
+ * MSHR is busy does it wait for the oldest fill.  An access to a block
+ * that is still on its way merges into that block's MSHR, whether the L1
+ * already counted it as a hit or not.  Other hits cost what they always
+ * did.  A LW's register is ready when its data is.  Returns the cycles the
+ * push costs, like iplc_sim_trap_address() sets them.
+ */
+int iplc_sim_nonblocking_access(iplc_sim_t *sim, pipeline_t *mem, int hit, int cycles)
+{
+    unsigned int block = mem->data_address >> sim->l1d->blockoffsetbits;
+    unsigned int now = sim->pipeline_cycles, ready;
+    int i = iplc_sim_mshr_find(sim, block), stall = 0, oldest;
+
+    if (i >= 0) {
+        sim->mshr_secondary++;
+        ready = sim->mshr_ready[i];
+    }
+    else if (hit) {
+        ready = now + cycles;
+        stall = cycles - 1;
+    }
+    else {
+        if (sim->mshr_count == sim->mshrs) {
+            for (oldest = 0, i = 1; i < sim->mshr_count; i++) {
+                if (sim->mshr_ready[i] < sim->mshr_ready[oldest])
+                    oldest = i;
+            }
+            stall = sim->mshr_ready[oldest] - now;
+            sim->mshr_full++;
+            sim->mshr_full_cycles += stall;
+            sim->mshr_count--;
+            sim->mshr_block[oldest] = sim->mshr_block[sim->mshr_count];
+            sim->mshr_ready[oldest] = sim->mshr_ready[sim->mshr_count];
+        }
+        ready = now + stall + cycles;
+        sim->mshr_block[sim->mshr_count] = block;
+        sim->mshr_ready[sim->mshr_count++] = ready;
+        sim->mshr_primary++;
+        sim->mshr_outstanding += sim->mshr_count;
+    }
+
+    if (mem->itype == LW && mem->dest_reg >= 0 && mem->dest_reg < MAX_REGISTERS &&
+        ready > sim->register_ready[mem->dest_reg])
+        sim->register_ready[mem->dest_reg] = ready;
+    return 1 + stall;
+}
+
+/*
+ * Hold the instruction in ALU until the registers it reads, including a
+ * LW or SW base, or an RTYPE's destination, are no longer waiting on a
+ * missed load.  Only add and addu have a second source register, the
+ * other RTYPEs have a constant there.  Returns the stall cycles.
+ */
+unsigned int iplc_sim_register_wait(iplc_sim_t *sim, pipeline_t *alu)
+{
+    int regs[3], count = 0, i;
+    unsigned int ready = sim->pipeline_cycles;
+
+    if (alu->itype == RTYPE) {
+        regs[count++] = alu->dest_reg;
+        regs[count++] = alu->reg1;
+        if (alu->op == OP_ADD || alu->op == OP_ADDU)
+            regs[count++] = alu->reg2_or_constant;
+    }
+    else if (alu->itype == LW || alu->itype == SW) {
+        regs[count++] = alu->reg2_or_constant;
+        if (alu->itype == SW)
+            regs[count++] = alu->reg1;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (regs[i] >= 0 && regs[i] < MAX_REGISTERS && sim->register_ready[regs[i]] > ready)
+            ready = sim->register_ready[regs[i]];
+    }
+    sim->mshr_use_cycles += ready - sim->pipeline_cycles;
+    if (sim->profile && ready > sim->pipeline_cycles)
+        iplc_sim_profile_stall(sim->profile, alu->instruction_address, ready - sim->pipeline_cycles);
+    return ready - sim->pipeline_cycles;
+}
+
+/*
+ * The first cycle from now that an instruction can have a result that
+ * leaves EX (an RTYPE) or MEM (a LW, load set) at ready; a cycle after
+ * that the result is in WRITEBACK.  EX->EX forwarding hands an RTYPE
+ * result on at once, MEM->EX forwarding hands either kind on while it is
+ * in WRITEBACK.  Otherwise it comes from the register file, written in the
+ * first half of WRITEBACK and read in DECODE.  A branch needs its
+ * registers in DECODE, everything else in ALU.
+ */
+static inline unsigned int iplc_sim_operand_time(iplc_sim_t *sim, unsigned int ready, int load, int decode,
+                                                 unsigned int now)
+{
+    unsigned int written = ready + !load;
+
+    if (now >= written + !decode)
+        return now;
+    if (!load && forward_ex[sim->forwarding] && now <= ready)
+        return ready;
+    if (forward_mem[sim->forwarding] && now <= written)
+        return written;
+    return written + !decode;
+}
+
+/*
+ * The registers an instruction reads, and the hazard kind of each.
+ * Returns how many, at most two.
+ */
+static inline int iplc_sim_source_regs(pipeline_t *stage, int *regs, int *kinds)
+{
+    int count = 0;
+
+    if (stage->itype == BRANCH) {
+        regs[count] = stage->reg1;
+        kinds[count++] = HAZARD_BRANCH;
+        regs[count] = stage->reg2_or_constant;
+        kinds[count++] = HAZARD_BRANCH;
+    }
+    else if (stage->itype == RTYPE) {
+        regs[count] = stage->reg1;
+        kinds[count++] = HAZARD_ALU_USE;
+        if (stage->op == OP_ADD || stage->op == OP_ADDU) {
+            regs[count] = stage->reg2_or_constant;
+            kinds[count++] = HAZARD_ALU_USE;
+        }
+    }
+    else if (stage->itype == LW || stage->itype == SW) {
+        regs[count] = stage->reg2_or_constant;
+        kinds[count++] = HAZARD_ADDRESS;
+        if (stage->itype == SW) {
+            regs[count] = stage->reg1;
+            kinds[count++] = HAZARD_STORE_DATA;
+        }
+    }
+    return count;
+}
+
+/*
+ * Stall the push until the branches in DECODE and the instructions in ALU
+ * have all of their registers; the original pipeline passes one of each,
+ * the superscalar one a group of each.  The table has every result up to
+ * the last push; a branch can also need the result of an instruction in
+ * ALU right now, which leaves EX (or MEM) in one push (or two).  The stall
+ * is charged to the hazard kind of the register that was latest.  Returns
+ * the stall cycles.
+ */
+unsigned int iplc_sim_scoreboard_stall(iplc_sim_t *sim, pipeline_t *decode, int decodes,
+                                       pipeline_t *alu, int alus)
+{
+    int regs[4 * MAX_WIDTH], kinds[4 * MAX_WIDTH], count = 0, owned = 0, i, j, kind = 0, load;
+    unsigned int pcs[4 * MAX_WIDTH], pc = 0;  // the instruction reading each register
+    unsigned int now = sim->pipeline_cycles, latest = now, ready, t;
+
+    for (i = 0; i < decodes; i++) {
+        if (decode[i].itype == BRANCH)
+            count += iplc_sim_source_regs(&decode[i], &regs[count], &kinds[count]);
+        for (; owned < count; owned++)
+            pcs[owned] = decode[i].instruction_address;
+    }
+    for (i = 0; i < alus; i++) {
+        if (alu[i].itype != BRANCH)
+            count += iplc_sim_source_regs(&alu[i], &regs[count], &kinds[count]);
+        for (; owned < count; owned++)
+            pcs[owned] = alu[i].instruction_address;
+    }
+
+    // $0 is never written
+    for (i = 0; i < count; i++) {
+        if (regs[i] <= 0 || regs[i] >= MAX_REGISTERS)
+            continue;
+        ready = sim->result_ready[regs[i]];
+        load = sim->result_load[regs[i]];
+        // the youngest writer in ALU wins
+        for (j = 0; kinds[i] == HAZARD_BRANCH && j < alus; j++) {
+            if ((alu[j].itype == RTYPE || alu[j].itype == LW) && alu[j].dest_reg == regs[i]) {
+                load = alu[j].itype == LW;
+                ready = now + 1 + load;
+            }
+        }
+        t = iplc_sim_operand_time(sim, ready, load, kinds[i] == HAZARD_BRANCH, now);
+        if (t > latest) {
+            latest = t;
+            kind = kinds[i] == HAZARD_ALU_USE && load ? HAZARD_LOAD_USE : kinds[i];
+            pc = pcs[i];
+        }
+    }
+    if (latest == now)
+        return 0;
+    sim->hazard_stalls[kind]++;
+    sim->hazard_cycles[kind] += latest - now;
+    if (sim->profile)
+        iplc_sim_profile_stall(sim->profile, pc, latest - now);
+    return latest - now;
+}
+
+/*
+ * After a push, note when the results of the instructions in ALU and MEM
+ * leave EX (RTYPE) or MEM (LW).  A LW in ALU is expected to leave MEM a
+ * push later, and the push that takes it through MEM corrects that.  An
+ * instruction is only noted once it has read its own registers, so it
+ * never waits for itself.
+ */
+void iplc_sim_scoreboard_update(iplc_sim_t *sim, pipeline_t *alu, int alus, pipeline_t *mem, int mems)
+{
+    unsigned int end = sim->pipeline_cycles;
+    int reg, i;
+
+    for (i = 0; i < mems; i++) {
+        if (mem[i].itype == LW && (reg = mem[i].dest_reg) > 0 && reg < MAX_REGISTERS) {
+            sim->result_ready[reg] = end;
+            if (sim->mshrs && sim->register_ready[reg] > end)
+                sim->result_ready[reg] = sim->register_ready[reg];
+            sim->result_load[reg] = TRUE;
+        }
+    }
+    // the younger instruction goes last, so it wins
+    for (i = 0; i < alus; i++) {
+        if ((alu[i].itype == RTYPE || alu[i].itype == LW) && (reg = alu[i].dest_reg) > 0 && reg < MAX_REGISTERS) {
+            sim->result_ready[reg] = end + (alu[i].itype == LW);
+            sim->result_load[reg] = alu[i].itype == LW;
+        }
+    }
+}
+
+/*
+ * The L1D access of the LW or SW in MEM.  Returns the cycles it costs,
+ * like iplc_sim_trap_address() sets them.
+ */
+int iplc_sim_memory_stage(iplc_sim_t *sim, pipeline_t *mem)
+{
+    int data_hit, data_cycles = 1, tlb_cycles = 0;
+
+    sim->access_pc = mem->instruction_address;
+    if (sim->tlb_entries)
+        tlb_cycles = iplc_sim_translate(sim, TLB_D, mem->data_address);
+    if (sim->multicore)
+        data_hit = iplc_sim_coherent_access(sim, mem->data_address, mem->itype == SW, &data_cycles);
+    else if (mem->itype == SW && sim->write_model)
+        data_hit = iplc_sim_store(sim, mem->data_address, TRUE, &data_cycles);
+    else
+        data_hit = iplc_sim_trap_address(sim, sim->l1d, mem->data_address, &data_cycles);
+    sim->data_accesses++;
+    sim->data_misses += !data_hit;
+    if (!data_hit && sim->verbose >= VERBOSE_ACCESS)
+        printf("DATA MISS: ADDRESS 0x%x\n", mem->data_address);
+    else if (sim->verbose >= VERBOSE_ACCESS)
+        printf("DATA HIT: ADDRESS 0x%x\n", mem->data_address);
+    if (sim->events)
+        iplc_sim_event_record(sim->events, mem->itype == LW ? (data_hit ? EVENT_LOAD_HIT : EVENT_LOAD_MISS)
+                                                            : (data_hit ? EVENT_STORE_HIT : EVENT_STORE_MISS),
+                              sim->pipeline_cycles, mem->instruction_address, mem->data_address);
+    if (sim->mshrs)
+        data_cycles = iplc_sim_nonblocking_access(sim, mem, data_hit, data_cycles);
+    // a miss may go on under the MSHRs, its translation can not
+    data_cycles += tlb_cycles;
+    sim->stall_data_tlb += tlb_cycles;
+    if (sim->profile)
+        iplc_sim_profile_data(sim->profile, mem, data_hit, data_cycles);
+    return data_cycles;
+}
+
+/*
+ * Check if various stages of our pipeline require stalls, forwarding, etc.
+ * Then push the contents of our various pipeline stages through the pipeline.
+ */
+void iplc_sim_push_pipeline_stage(iplc_sim_t *sim)
+{
+	int data_cycles = 1;
+	int normalProcessing = TRUE;
+	unsigned int start_cycles = sim->pipeline_cycles;
+	int branch_stall = 0, load_use_stall = 0;
+	pipeline_t *fetch = iplc_sim_stage(sim, FETCH);
+	pipeline_t *decode = iplc_sim_stage(sim, DECODE);
+	pipeline_t *alu = iplc_sim_stage(sim, ALU);
+	pipeline_t *mem = iplc_sim_stage(sim, MEM);
+	pipeline_t *writeback = iplc_sim_stage(sim, WRITEBACK);
+	/* 1. Count WRITEBACK stage is "retired" -- This I'm giving you */
+	if (writeback->instruction_address) {
+		sim->instruction_count++;
+		if (sim->debug)
+			printf("DEBUG: Retired Instruction at 0x%x, Type %d, at Time %u \n",
+				writeback->instruction_address, writeback->itype, sim->pipeline_cycles);
+		if (sim->events)
+			iplc_sim_event_record(sim->events, EVENT_RETIRE, sim->pipeline_cycles,
+			                      writeback->instruction_address, 0);
+		if (sim->instruction_count == sim->interval_next)
+			iplc_sim_interval_emit(sim);
+	}
+
+	/* Under the scoreboard every RAW hazard stalls here, before anything reads its registers */
+	if (sim->scoreboard) {
+		load_use_stall = iplc_sim_scoreboard_stall(sim, decode, 1, alu, 1);
+		sim->pipeline_cycles += load_use_stall;
+	}
+
+	/* 2. Check for BRANCH and correct/incorrect Branch Prediction */
+    if (decode->itype == BRANCH) {
+		sim->branch_count++;
+		//assuming that the instructions are in order, the next instruction will just be the one in the fetch stage
+		//if the next instruction is a NOP then don't predict, train or count anything
+        if (fetch->itype != NOP) {
+            int correct = iplc_sim_branch_resolve(sim, decode->instruction_address,
+                                                  fetch->instruction_address);
+            if (sim->events)
+                iplc_sim_event_record(sim->events, correct ? EVENT_BRANCH_CORRECT : EVENT_BRANCH_MISPREDICT,
+                                      sim->pipeline_cycles, decode->instruction_address,
+                                      fetch->instruction_address);
+            if (correct) {
+                sim->correct_branch_predictions++;
+            }
+            else { //prediction was wrong and a NOP needs to be inserted
+                sim->branch_mispredictions++;
+			    sim->pipeline_cycles+=2; //extra stall cycle. adds 2 because of the 1 additional stall and 1 normal processing
+			    normalProcessing = FALSE;
+			    branch_stall = 1;
+			    if (sim->profile) {
+			        iplc_sim_profile_entry(&sim->profile->pcs, decode->instruction_address)->mispredictions++;
+			        iplc_sim_profile_stall(sim->profile, decode->instruction_address, branch_stall);
+			    }
+            }
+        }
+	}
+
+	/* 3. Check for LW delays due to use in ALU stage and if data hit/miss
+	 *    add delay cycles if needed.
+	 */
+	if (mem->itype == LW) {
+		//check for data miss
+		data_cycles = iplc_sim_memory_stage(sim, mem);
+        if (data_cycles > 1) { //not found in the L1 (or a slow L1), need to add stall
+			sim->pipeline_cycles += data_cycles; //stall cycles for a data hazard
+			normalProcessing = FALSE;
+        }
+        //need to check for the ALU delays, the scoreboard already did
+        if (alu->itype==LW && !sim->scoreboard) {
+            if (mem->dest_reg == alu->dest_reg) {
+                sim->pipeline_cycles+=1; //need to stall for a cycle
+                load_use_stall++;
+                if (sim->profile)
+                    iplc_sim_profile_stall(sim->profile, alu->instruction_address, 1);
+            }
+        }
+        if (alu->itype==SW && !sim->scoreboard) {
+            if (mem->dest_reg == alu->reg1) {
+                sim->pipeline_cycles+=1; //need to stall for a cycle
+                load_use_stall++;
+                if (sim->profile)
+                    iplc_sim_profile_stall(sim->profile, alu->instruction_address, 1);
+            }
+        }
+    }
+	/* 4. Check for SW mem acess and data miss .. add delay cycles if needed */
+	if (mem->itype == SW) {
+		data_cycles = iplc_sim_memory_stage(sim, mem);
+        if (data_cycles > 1) { //not found in the L1 (or a slow L1), need to add stall
+			sim->pipeline_cycles += data_cycles;
+			normalProcessing = FALSE;
+        }
+	}
+
+	/* 5. Increment pipe_cycles 1 cycle for normal processing */
+	if (normalProcessing) {
+		sim->pipeline_cycles++; //if normalProcessing is false than the pipeline cycles have already been added
+	}
+	// under the non-blocking cache a missed load only stalls the instruction that needs it
+	if (sim->mshrs)
+		sim->pipeline_cycles += iplc_sim_register_wait(sim, alu);
+	if (sim->scoreboard)
+		iplc_sim_scoreboard_update(sim, alu, 1, mem, 1);
+	// whatever this push cost beyond its one cycle and the stalls above came from the data access
+	sim->stall_branch += branch_stall;
+	sim->stall_load_use += load_use_stall;
+	sim->stall_data += sim->pipeline_cycles - start_cycles - 1 - branch_stall - load_use_stall;
+
+	/* 6. push stages thru MEM->WB, ALU->MEM, DECODE->ALU, FETCH->DECODE */
+	// every stage moves down one slot of the ring, and the slot WRITEBACK
+	// leaves becomes the new FETCH
+	sim->pipeline_head = sim->pipeline_head ? sim->pipeline_head - 1 : MAX_STAGES - 1;
+    
+    // 7. This is a give'me -- Reset the FETCH stage to NOP via bezero */
+    bzero(writeback, sizeof(pipeline_t));
+}
+
+/*
+ * TRUE if no stage of the superscalar pipeline holds an instruction.
+ */
+int iplc_sim_group_empty(iplc_sim_t *sim)
+{
+    int i;
+
+    for (i = 0; i < sim->pipeline_depth; i++) {
+        if (sim->group[i].count)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * iplc_sim_push_pipeline_stage() for the superscalar pipeline, every stage
+ * moves as a group.  The whole WRITEBACK group retires at once.  The MEM
+ * group has a memory port for each LW/SW, but a blocking L1D serves the
+ * slow ones one after another.  A mispredicted branch costs a cycle for
+ * every stage in front of DECODE.  The scoreboard always checks the
+ * registers, the groups never hold a RAW hazard within themselves.
+ */
+void iplc_sim_push_group(iplc_sim_t *sim)
+{
+    int back = sim->pipeline_depth - MAX_STAGES;
+    unsigned int start_cycles = sim->pipeline_cycles;
+    unsigned int branch_stall = 0, load_use_stall, data_stall = 0;
+    pipeline_group_t *next = iplc_sim_group(sim, back + DECODE - 1);
+    pipeline_group_t *decode = iplc_sim_group(sim, back + DECODE);
+    pipeline_group_t *alu = iplc_sim_group(sim, back + ALU);
+    pipeline_group_t *mem = iplc_sim_group(sim, back + MEM);
+    pipeline_group_t *writeback = iplc_sim_group(sim, back + WRITEBACK);
+    pipeline_t *stage;
+    int i, data_cycles;
+
+    /* 1. Count the WRITEBACK group as retired */
+    for (i = 0; i < writeback->count; i++) {
+        stage = &writeback->slot[i];
+        if (!stage->instruction_address)
+            continue;
+        sim->instruction_count++;
+        if (sim->debug)
+            printf("DEBUG: Retired Instruction at 0x%x, Type %d, at Time %u \n",
+                   stage->instruction_address, stage->itype, sim->pipeline_cycles);
+        if (sim->events)
+            iplc_sim_event_record(sim->events, EVENT_RETIRE, sim->pipeline_cycles, stage->instruction_address, 0);
+        if (sim->instruction_count == sim->interval_next)
+            iplc_sim_interval_emit(sim);
+    }
+    if (writeback->count)
+        sim->group_retired[writeback->count]++;
+
+    /* 2. RAW hazards between the groups */
+    load_use_stall = iplc_sim_scoreboard_stall(sim, decode->slot, decode->count, alu->slot, alu->count);
+    sim->pipeline_cycles += load_use_stall;
+
+    /* 3. A branch ends its group, so the next instruction starts the group behind it */
+    for (i = 0; i < decode->count; i++) {
+        stage = &decode->slot[i];
+        if (stage->itype != BRANCH)
+            continue;
+        sim->branch_count++;
+        if (next->count && next->slot[0].itype != NOP) {
+            int correct = iplc_sim_branch_resolve(sim, stage->instruction_address,
+                                                  next->slot[0].instruction_address);
+            if (sim->events)
+                iplc_sim_event_record(sim->events, correct ? EVENT_BRANCH_CORRECT : EVENT_BRANCH_MISPREDICT,
+                                      sim->pipeline_cycles, stage->instruction_address,
+                                      next->slot[0].instruction_address);
+            if (correct) {
+                sim->correct_branch_predictions++;
+            }
+            else {
+                sim->branch_mispredictions++;
+                branch_stall = back + DECODE;
+                if (sim->profile) {
+                    iplc_sim_profile_entry(&sim->profile->pcs, stage->instruction_address)->mispredictions++;
+                    iplc_sim_profile_stall(sim->profile, stage->instruction_address, branch_stall);
+                }
+            }
+        }
+    }
+
+    /* 4. The loads and stores of the MEM group */
+    for (i = 0; i < mem->count; i++) {
+        if (mem->slot[i].itype == LW || mem->slot[i].itype == SW) {
+            data_cycles = iplc_sim_memory_stage(sim, &mem->slot[i]);
+            if (data_cycles > 1)
+                data_stall += data_cycles - 1;
+        }
+    }
+
+    /* 5. One cycle for the push, and the stalls */
+    sim->pipeline_cycles += 1 + branch_stall + data_stall;
+    for (i = 0; sim->mshrs && i < alu->count; i++)
+        sim->pipeline_cycles += iplc_sim_register_wait(sim, &alu->slot[i]);
+    iplc_sim_scoreboard_update(sim, alu->slot, alu->count, mem->slot, mem->count);
+    sim->stall_branch += branch_stall;
+    sim->stall_load_use += load_use_stall;
+    sim->stall_data += sim->pipeline_cycles - start_cycles - 1 - branch_stall - load_use_stall;
+
+    /* 6. Every group moves down one slot of the ring, WRITEBACK's becomes the new FETCH */
+    // only the first count slots of a group are ever read, so the rest need not be cleared
+    sim->pipeline_head = sim->pipeline_head ? sim->pipeline_head - 1 : sim->pipeline_depth - 1;
+    writeback->count = writeback->memory_ops = writeback->alu_ops = writeback->closed = 0;
+}
+
+/*
+ * Push the pipeline the given number of times while the fetch stage waits.
+ * Once every stage holds an empty (all zero) entry a push only costs one
+ * cycle and changes nothing else, so the rest are skipped in one step.
+ */
+void iplc_sim_stall_pipeline(iplc_sim_t *sim, unsigned int pushes)
+{
+    int i;
+
+    if (sim->issue_width) {
+        // the wait ends the group being fetched
+        if (pushes && iplc_sim_group(sim, FETCH)->count)
+            sim->group_ends[GROUP_FETCH]++;
+        for (; pushes && !iplc_sim_group_empty(sim); pushes--)
+            iplc_sim_push_group(sim);
+        sim->pipeline_cycles += pushes;
+        return;
+    }
+
+    while (pushes) {
+        for (i = 0; i < MAX_STAGES; i++) {
+            if (sim->pipeline[i].itype != NOP || sim->pipeline[i].instruction_address)
+                break;
+        }
+        if (i == MAX_STAGES) {
+            sim->pipeline_cycles += pushes;
+            return;
+        }
+        iplc_sim_push_pipeline_stage(sim);
+        pushes--;
+    }
+}
+
+void iplc_sim_process_pipeline_rtype(iplc_sim_t *sim, int op, int dest_reg, int reg1, int reg2_or_constant)
+{
+    pipeline_t *fetch;
+
+    /* This is an example of what you need to do for the rest */
+    iplc_sim_push_pipeline_stage(sim);
+    fetch = iplc_sim_stage(sim, FETCH);
+    
+    fetch->itype = RTYPE;
+    fetch->instruction_address = sim->instruction_address;
+    
+    fetch->op = op;
+    fetch->reg1 = reg1;
+    fetch->reg2_or_constant = reg2_or_constant;
+    fetch->dest_reg = dest_reg;
+}
+
+void iplc_sim_process_pipeline_lw(iplc_sim_t *sim, int dest_reg, int base_reg, unsigned int data_address)
+{
+    pipeline_t *fetch;
+
+    /* You must implement this function */
+	iplc_sim_push_pipeline_stage(sim); //pushing the pipeline along
+	fetch = iplc_sim_stage(sim, FETCH);
+    
+    //setting the pipeline fetch stage to the appropriate values
+	fetch->itype = LW;
+	fetch->instruction_address = sim->instruction_address;
+	fetch->op = OP_LW;
+
+    //setting the registers
+	fetch->dest_reg = dest_reg;
+	fetch->reg2_or_constant = base_reg;
+	fetch->data_address = data_address;
+}
+
+void iplc_sim_process_pipeline_sw(iplc_sim_t *sim, int src_reg, int base_reg, unsigned int data_address)
+{
+    pipeline_t *fetch;
+
+    /* You must implement this function */
+	iplc_sim_push_pipeline_stage(sim); //pushing the pipeline along
+	fetch = iplc_sim_stage(sim, FETCH);
+    
+    //setting the pipeline fetch stage to the appropriate values
+	fetch->itype = SW;
+	fetch->instruction_address = sim->instruction_address;
+	fetch->op = OP_SW;
+
+    //setting the registers
+	fetch->reg1 = src_reg;
+	fetch->reg2_or_constant = base_reg;
+	fetch->data_address = data_address;
+}
+
+void iplc_sim_process_pipeline_branch(iplc_sim_t *sim, int reg1, int reg2)
+{
+    pipeline_t *fetch;
+
+    /* You must implement this function */
+	iplc_sim_push_pipeline_stage(sim);  //pushing the pipeline along
+	fetch = iplc_sim_stage(sim, FETCH);
+    
+    //setting the pipeline fetch stage to the appropriate values
+	fetch->itype = BRANCH;
+	fetch->instruction_address = sim->instruction_address;
+	fetch->op = OP_BEQ;
+
+    //setting the registers
+	fetch->reg1 = reg1;
+	fetch->reg2_or_constant = reg2;
+}
+
+void iplc_sim_process_pipeline_jump(iplc_sim_t *sim, int op)
+{
+    pipeline_t *fetch;
+
+    /* You must implement this function */
+	iplc_sim_push_pipeline_stage(sim);  //pushing the pipeline along
+	fetch = iplc_sim_stage(sim, FETCH);
+    
+    //setting the pipeline fetch stage to the appropriate values
+	fetch->itype = JUMP;
+	fetch->instruction_address = sim->instruction_address;
+
+    //the opcode stands in for the mnemonic
+	fetch->op = op;
+}
+
+void iplc_sim_process_pipeline_syscall(iplc_sim_t *sim)
+{
+    pipeline_t *fetch;
+
+    /* You must implement this function */
+	iplc_sim_push_pipeline_stage(sim);  //pushing the pipeline along
+	fetch = iplc_sim_stage(sim, FETCH);
+    
+    //setting the pipeline fetch stage to the appropriate values
+	fetch->itype = SYSCALL;
+	fetch->instruction_address = sim->instruction_address;
+	fetch->op = OP_SYSCALL;
+
+}
+
+/*
+ * Put the next instruction in the FETCH group of the superscalar pipeline.
+ * An empty group is pushed on first, like the original pipeline pushes
+ * before every instruction.  So is a group that can not take it: it is
+ * full, the memory ports or ALUs it needs are taken, it reads a register
+ * an older instruction in the group writes, or a branch or jump ended it.
+ */
+void iplc_sim_issue_group(iplc_sim_t *sim, iplc_inst_t *inst)
+{
+    pipeline_group_t *fetch = iplc_sim_group(sim, FETCH);
+    pipeline_t entry;
+    int regs[2], kinds[2], count, i, j, end = -1;
+
+    entry.instruction_address = inst->instruction_address;
+    entry.data_address = inst->data_address;
+    entry.dest_reg = inst->dest_reg;
+    entry.reg1 = inst->reg1;
+    entry.reg2_or_constant = inst->reg2_or_constant;
+    entry.itype = opcode_itypes[inst->op];
+    entry.op = inst->op;
+
+    if (fetch->count == sim->issue_width)
+        end = GROUP_WIDTH;
+    else if (fetch->closed)
+        end = GROUP_CONTROL;
+    else if ((entry.itype == LW || entry.itype == SW) && fetch->memory_ops == sim->memory_ports)
+        end = GROUP_PORTS;
+    else if (entry.itype == RTYPE && fetch->alu_ops == sim->alus)
+        end = GROUP_ALUS;
+    else {
+        count = iplc_sim_source_regs(&entry, regs, kinds);
+        for (i = 0; i < count; i++) {
+            for (j = 0; regs[i] > 0 && j < fetch->count; j++) {
+                if ((fetch->slot[j].itype == RTYPE || fetch->slot[j].itype == LW) &&
+                    fetch->slot[j].dest_reg == regs[i])
+                    end = GROUP_DEPENDENCY;
+            }
+        }
+    }
+
+    if (end >= 0 && fetch->count)
+        sim->group_ends[end]++;
+    if (end >= 0 || !fetch->count) {
+        iplc_sim_push_group(sim);
+        fetch = iplc_sim_group(sim, FETCH);
+    }
+    fetch->slot[fetch->count++] = entry;
+    fetch->memory_ops += entry.itype == LW || entry.itype == SW;
+    fetch->alu_ops += entry.itype == RTYPE;
+    fetch->closed = entry.itype == BRANCH || entry.itype == JUMP;
+}
+
+void iplc_sim_process_pipeline_nop(iplc_sim_t *sim)
+{
+    pipeline_t *fetch;
+
+    /* You must implement this function */
+	iplc_sim_push_pipeline_stage(sim);  //pushing the pipeline along
+	fetch = iplc_sim_stage(sim, FETCH);
+    
+    //setting the pipeline fetch stage to the appropriate values
+	fetch->itype = NOP;
+	fetch->instruction_address = sim->instruction_address;
+	fetch->op = OP_NOP;
+}
+
+/************************************************************************************************/
+/* parse Function *******************************************************************************/
+/************************************************************************************************/
+
+#define TRACE_SPACE(c) ((c) == ' ' || (c) == '\t' || (c) == '\n' || (c) == '\r' || \
+                        (c) == '\v' || (c) == '\f')
+
+uint64_t opcode_keys[OP_COUNT];  // opcode_names packed by iplc_sim_opcode_key()
+
+/*
+ * Pack a mnemonic of up to 8 characters into one integer so interning is a
+ * handful of integer compares.  Longer mnemonics get key 0.
+ */
+uint64_t iplc_sim_opcode_key(const char *name, int len)
+{
+    uint64_t key = 0;
+
+    if (len > 8)
+        return 0;
+    memcpy(&key, name, len);
+    return key;
+}
+
+/*
+ * Intern a mnemonic.  Anything starting with one of the accepted prefixes
+ * ("addx", "jalr", ...) is handled like that instruction class, as the
+ * original strncmp() chain did.  Returns -1 for an unknown instruction.
+ */
+int iplc_sim_intern_opcode(char *instruction)
+{
+    int op;
+
+    for (op = 0; op < OP_COUNT; op++) {
+        if (strcmp(instruction, opcode_names[op]) == 0)
+            return op;
+    }
+
+    if (strncmp( instruction, "add", 3 ) == 0)
+        return OP_ADD;
+    if (strncmp( instruction, "sll", 3 ) == 0)
+        return OP_SLL;
+    if (strncmp( instruction, "ori", 3 ) == 0)
+        return OP_ORI;
+    if (strncmp( instruction, "lui", 3 ) == 0)
+        return OP_LUI;
+    if (strncmp( instruction, "lw", 2 ) == 0)
+        return OP_LW;
+    if (strncmp( instruction, "sw", 2 ) == 0)
+        return OP_SW;
+    if (strncmp( instruction, "beq", 3 ) == 0)
+        return OP_BEQ;
+    if (strncmp( instruction, "jal", 3 ) == 0)
+        return OP_JAL;
+    if (strncmp( instruction, "jr", 2 ) == 0)
+        return OP_JR;
+    if (strncmp( instruction, "j", 1 ) == 0)
+        return OP_J;
+    if (strncmp( instruction, "syscall", 7 ) == 0)
+        return OP_SYSCALL;
+    if (strncmp( instruction, "nop", 3 ) == 0)
+        return OP_NOP;
+    return -1;
+}
+
+/*
+ * Copy a mnemonic token into a 16 character buffer as a string.
+ */
+char *iplc_sim_token_name(const char *token, int len, char *instruction)
+{
+    if (len > 15)
+        len = 15;
+    memcpy(instruction, token, len);
+    instruction[len] = '\0';
+    return instruction;
+}
+
+/*
+ * Fill opcode_keys.  The first text trace line does it; threads that read
+ * traces at once need it done before they start.
+ */
+void iplc_sim_opcode_keys_init()
+{
+    int op;
+
+    for (op = 0; op < OP_COUNT; op++)
+        opcode_keys[op] = iplc_sim_opcode_key(opcode_names[op], strlen(opcode_names[op]));
+}
+
+/*
+ * Intern a mnemonic token in place, only copying it for the rare prefix
+ * match fall back.
+ */
+int iplc_sim_intern_token(const char *token, int len)
+{
+    uint64_t key = iplc_sim_opcode_key(token, len);
+    char instruction[16];
+    int op;
+
+    if (opcode_keys[OP_NOP] == 0)
+        iplc_sim_opcode_keys_init();
+
+    for (op = 0; key && op < OP_COUNT; op++) {
+        if (key == opcode_keys[op])
+            return op;
+    }
+    return iplc_sim_intern_opcode(iplc_sim_token_name(token, len, instruction));
+}
+
+/*
+ * The tokenizer.  These replace the sscanf() conversions the text trace
+ * used and work in place on [*p, end) of a single line, advancing *p.
+ * iplc_sim_scan_token() is "%s" and returns the token length, 0 for none.
+ */
+int iplc_sim_scan_token(const char **p, const char *end, const char **token)
+{
+    const char *s = *p;
+
+    while (s < end && TRACE_SPACE(*s))
+        s++;
+    *token = s;
+    while (s < end && !TRACE_SPACE(*s))
+        s++;
+    *p = s;
+    return s - *token;
+}
+
+/*
+ * "%x", with the optional sign and 0x prefix.  Returns 0 with no digits.
+ */
+int iplc_sim_scan_hex(const char **p, const char *end, unsigned int *value)
+{
+    const char *s = *p;
+    const char *digits;
+    unsigned int v = 0;
+    int negative = FALSE;
+
+    while (s < end && TRACE_SPACE(*s))
+        s++;
+    if (s < end && (*s == '-' || *s == '+'))
+        negative = *s++ == '-';
+    if (end - s > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+        s += 2;
+
+    for (digits = s; s < end; s++) {
+        if (*s >= '0' && *s <= '9')
+            v = (v << 4) | (*s - '0');
+        else if ((*s | 0x20) >= 'a' && (*s | 0x20) <= 'f')
+            v = (v << 4) | ((*s | 0x20) - 'a' + 10);
+        else
+            break;
+    }
+    if (s == digits)
+        return 0;
+
+    *value = negative ? -v : v;
+    *p = s;
+    return 1;
+}
+
+/*
+ * A register or constant token: "$29," gives 29, "-4" gives -4.  Like the
+ * old iplc_sim_parse_reg() this is atoi() of the token after any '$', so the
+ * rest of the token is skipped.  Returns 0 if there is no token.
+ */
+int iplc_sim_scan_reg(const char **p, const char *end, int *value)
+{
+    const char *token;
+    const char *s;
+    int len = iplc_sim_scan_token(p, end, &token);
+    int negative = FALSE;
+    int v = 0;
+
+    if (len == 0)
+        return 0;
+
+    s = token;
+    if (*s == '$')
+        s++;
+    if (s < *p && (*s == '-' || *s == '+'))
+        negative = *s++ == '-';
+    for (; s < *p && *s >= '0' && *s <= '9'; s++)
+        v = v * 10 + (*s - '0');
+
+    *value = negative ? -v : v;
+    return 1;
+}
+
+/*
+ * The base register of a LW/SW operand such as 0($29):, -1 if it has none.
+ */
+int iplc_sim_base_reg(const char *token, int len)
+{
+    const char *s = (const char*) memchr(token, '(', len);
+    const char *end = token + len;
+    int v = 0;
+
+    if (s == NULL || ++s == end)
+        return -1;
+    if (*s == '$')
+        s++;
+    if (s == end || *s < '0' || *s > '9')
+        return -1;
+    for (; s < end && *s >= '0' && *s <= '9'; s++)
+        v = v * 10 + (*s - '0');
+    return v;
+}
+
+/*
+ * Decode one line of a text trace, [p, end).  There is no limit on the
+ * line length and nothing is copied.
+ */
+void iplc_sim_decode_line(const char *p, const char *end, iplc_inst_t *inst)
+{
+    const char *token;
+    const char *ignored;
+    const char *operand;
+    char instruction[16];
+    int len, operand_len;
+    
+    if (!iplc_sim_scan_hex(&p, end, &inst->instruction_address) ||
+        (len = iplc_sim_scan_token(&p, end, &token)) == 0) {
+        printf("Malformed instruction \n");
+        exit(-1);
+    }
+    
+    inst->op = iplc_sim_intern_token(token, len);
+    inst->data_address = 0;
+    inst->dest_reg = inst->reg1 = inst->reg2_or_constant = -1;
+    
+    switch (inst->op) {
+        case OP_ADD:
+        case OP_ADDI:
+        case OP_ADDIU:
+        case OP_ADDU:
+        case OP_SLL:
+        case OP_ORI:
+            if (!iplc_sim_scan_reg(&p, end, &inst->dest_reg) ||
+                !iplc_sim_scan_reg(&p, end, &inst->reg1) ||
+                !iplc_sim_scan_reg(&p, end, &inst->reg2_or_constant)) {
+                printf("Malformed RTYPE instruction (%s) at address 0x%x \n",
+                       iplc_sim_token_name(token, len, instruction), inst->instruction_address);
+                exit(-1);
+            }
+            break;
+            
+        case OP_LUI:
+            if (!iplc_sim_scan_reg(&p, end, &inst->dest_reg) ||
+                !iplc_sim_scan_token(&p, end, &ignored)) {
+                printf("Malformed RTYPE instruction (%s) at address 0x%x \n",
+                       iplc_sim_token_name(token, len, instruction), inst->instruction_address );
+                exit(-1);
+            }
+            break;
+            
+        case OP_LW:
+        case OP_SW:
+            // the base register is inside the offset(base): token
+            if (!iplc_sim_scan_reg(&p, end, inst->op == OP_LW ? &inst->dest_reg : &inst->reg1) ||
+                !(operand_len = iplc_sim_scan_token(&p, end, &operand)) ||
+                !iplc_sim_scan_hex(&p, end, &inst->data_address)) {
+                printf("Bad instruction: %s at address %x \n",
+                       iplc_sim_token_name(token, len, instruction), inst->instruction_address);
+                exit(-1);
+            }
+            inst->reg2_or_constant = iplc_sim_base_reg(operand, operand_len);
+            break;
+            
+        case OP_BEQ:
+            // the offset is not needed, the next instruction says where the branch went
+            if (!iplc_sim_scan_reg(&p, end, &inst->reg1) ||
+                !iplc_sim_scan_reg(&p, end, &inst->reg2_or_constant))
+                inst->reg1 = inst->reg2_or_constant = -1;
+            break;
+            
+        case OP_J:
+        case OP_JAL:
+        case OP_JR:
+            /*
+             * Note: no need to worry about forwarding on the jump register
+             * we'll let that one go.
+             */
+        case OP_SYSCALL:
+        case OP_NOP:
+            break;
+            
+        default:
+            printf("Do not know how to process instruction: %s at address %x \n",
+                   iplc_sim_token_name(token, len, instruction), inst->instruction_address );
+            exit(-1);
+    }
+}
+
+/*
+ * Run one decoded instruction: fetch it through the cache, then hand it to
+ * the pipeline.
+ */
+void iplc_sim_process_instruction(iplc_sim_t *sim, iplc_inst_t *inst)
+{
+    int instruction_hit = 0, instruction_cycles = 1, tlb_cycles = 0;
+    
+    if (sim->sample_detail && !iplc_sim_sample_step(sim)) {
+        iplc_sim_functional_instruction(sim, inst);
+        return;
+    }
+    
+    sim->instruction_address = inst->instruction_address;
+    sim->access_pc = 0;
+    if (sim->tlb_entries)
+        tlb_cycles = iplc_sim_translate(sim, TLB_I, sim->instruction_address);
+    instruction_hit = iplc_sim_trap_address(sim, sim->l1i, sim->instruction_address, &instruction_cycles);
+    instruction_cycles += tlb_cycles;
+    sim->stall_fetch_tlb += tlb_cycles;
+    sim->fetch_accesses++;
+    sim->fetch_misses += !instruction_hit;
+    sim->stall_fetch += instruction_cycles - 1;
+    if (sim->profile) {
+        profile_entry_t *entry = iplc_sim_profile_entry(&sim->profile->pcs, sim->instruction_address);
+
+        entry->executions++;
+        entry->fetch_misses += !instruction_hit;
+        entry->stall_cycles += instruction_cycles - 1;
+    }
+    
+    if (!instruction_hit && sim->verbose >= VERBOSE_ACCESS)
+        printf("INST MISS:\t Address 0x%x \n", sim->instruction_address);
+    else if (sim->verbose >= VERBOSE_ACCESS)
+        printf("INST HIT:\t Address 0x%x \n", sim->instruction_address);
+    if (sim->events)
+        iplc_sim_event_record(sim->events, instruction_hit ? EVENT_FETCH_HIT : EVENT_FETCH_MISS,
+                              sim->pipeline_cycles, sim->instruction_address, sim->instruction_address);
+    
+    // if a MISS (or a slow L1), then push current instruction thru pipeline
+    // need to subtract 1, since the stage is pushed once more for actual instruction processing
+    // also need to allow for a branch miss prediction during the fetch cache miss time -- by
+    // counting cycles this allows for these cycles to overlap and not doubly count.
+    iplc_sim_stall_pipeline(sim, instruction_cycles - 1);
+    
+    if (sim->issue_width) {
+        iplc_sim_issue_group(sim, inst);
+        return;
+    }
+    
+    switch (inst->op) {
+        case OP_ADD:
+        case OP_ADDI:
+        case OP_ADDIU:
+        case OP_ADDU:
+        case OP_SLL:
+        case OP_ORI:
+        case OP_LUI:
+            iplc_sim_process_pipeline_rtype(sim, inst->op, inst->dest_reg,
+                                            inst->reg1, inst->reg2_or_constant);
+            break;
+        case OP_LW:
+            iplc_sim_process_pipeline_lw(sim, inst->dest_reg, inst->reg2_or_constant, inst->data_address);
+            break;
+        case OP_SW:
+            iplc_sim_process_pipeline_sw(sim, inst->reg1, inst->reg2_or_constant, inst->data_address);
+            break;
+        case OP_BEQ:
+            iplc_sim_process_pipeline_branch(sim, inst->reg1, inst->reg2_or_constant);
+            break;
+        case OP_J:
+        case OP_JAL:
+        case OP_JR:
+            iplc_sim_process_pipeline_jump(sim, inst->op);
+            break;
+        case OP_SYSCALL:
+            iplc_sim_process_pipeline_syscall(sim);
+            break;
+        case OP_NOP:
+            iplc_sim_process_pipeline_nop(sim);
+            break;
+    }
+}
+
+/*
+ * Parse and run one line of a text trace.
+ */
+void iplc_sim_parse_instruction(iplc_sim_t *sim, char *buffer)
+{
+    iplc_inst_t inst;
+
+    iplc_sim_decode_line(buffer, buffer + strlen(buffer), &inst);
+    iplc_sim_process_instruction(sim, &inst);
+}
+
+/************************************************************************************************/
+/* Trace Functions ******************************************************************************/
+/************************************************************************************************/
+
+/*
+ * The binary trace is TRACE_MAGIC followed by one variable length record
+ * per instruction:
+ *
+ *   opcode      1 byte, enum opcode
+ *   address     zigzag varint, delta from the previous address + 4
+ *   operands    by opcode: RTYPE  dest, reg1, reg2_or_constant (zigzag varints)
+ *                          LUI    dest
+ *                          LW/SW  register, base register, then the data
+ *                                 address as a zigzag varint delta from the
+ *                                 previous data address
+ *                          BEQ    reg1, reg2
+ *
+ * Version 1 traces (IPLCTRC1) are still read; they have no base register
+ * and no BEQ registers, those read as -1.
+ *
+ * Straight line code with small register numbers costs 5 bytes for an add
+ * and 2 bytes for a branch, against ~30 bytes of text.
+ */
+
+void iplc_sim_trace_put_varint(BYTE **out, uint value)
+{
+    while (value >= 0x80) {
+        *(*out)++ = (BYTE) (value | 0x80);
+        value >>= 7;
+    }
+    *(*out)++ = (BYTE) value;
+}
+
+/*
+ * Signed values are zigzag encoded first so small negative deltas stay short.
+ */
+void iplc_sim_trace_put_signed(BYTE **out, int value)
+{
+    iplc_sim_trace_put_varint(out, ((uint) value << 1) ^ (uint) (value >> 31));
+}
+
+uint iplc_sim_trace_get_varint(trace_t *trace)
+{
+    uint value = 0;
+    int shift;
+
+    for (shift = 0; shift < 35; shift += 7) {
+        if (trace->pos >= trace->len) {
+            printf("Truncated binary trace \n");
+            exit(-1);
+        }
+        BYTE byte = trace->buffer[trace->pos++];
+        value |= (uint) (byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return value;
+    }
+    printf("Bad varint in binary trace \n");
+    exit(-1);
+}
+
+int iplc_sim_trace_get_signed(trace_t *trace)
+{
+    uint value = iplc_sim_trace_get_varint(trace);
+
+    return (int) (value >> 1) ^ -(int) (value & 1);
+}
+
+/*
+ * Open a trace, text or binary.  Binary traces are told apart by their
+ * magic number so either kind can be given at the prompt.  Regular files
+ * are mapped and read in place; pipes and the like fall back to stdio.
+ */
+void iplc_sim_trace_open(trace_t *trace, char *name)
+{
+    char magic[sizeof(TRACE_MAGIC) - 1];
+    struct stat st;
+    int c;
+
+    bzero(trace, sizeof(trace_t));
+    trace->file = fopen(name, "rb");
+    
+    if ( trace->file == NULL ) {
+        printf("fopen failed for %s file\n", name);
+        exit(-1);
+    }
+
+    if (fstat(fileno(trace->file), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        trace->map = (char*) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(trace->file), 0);
+        if (trace->map == MAP_FAILED) {
+            trace->map = NULL;
+        }
+        else {
+            trace->map_size = st.st_size;
+            madvise(trace->map, trace->map_size, MADV_SEQUENTIAL);
+        }
+    }
+
+    if (trace->map) {
+        trace->binary = trace->map_size >= sizeof(magic) &&
+                        memcmp(trace->map, TRACE_MAGIC, sizeof(magic) - 1) == 0 &&
+                        trace->map[sizeof(magic) - 1] >= '1' && trace->map[sizeof(magic) - 1] <= '0' + TRACE_VERSION;
+        if (trace->binary)
+            trace->version = trace->map[sizeof(magic) - 1] - '0';
+        trace->buffer = (BYTE*) trace->map;
+        trace->len = trace->map_size;
+        trace->pos = trace->binary ? sizeof(magic) : 0;
+    }
+    else if ((c = getc(trace->file)) == TRACE_MAGIC[0]) {
+        // can't seek back on a pipe, but a text trace never starts with 'I'
+        if (fread(magic + 1, 1, sizeof(magic) - 1, trace->file) != sizeof(magic) - 1 ||
+            memcmp(magic + 1, TRACE_MAGIC + 1, sizeof(magic) - 2) != 0 ||
+            magic[sizeof(magic) - 1] < '1' || magic[sizeof(magic) - 1] > '0' + TRACE_VERSION) {
+            printf("Bad binary trace header in %s \n", name);
+            exit(-1);
+        }
+        trace->binary = TRUE;
+        trace->version = magic[sizeof(magic) - 1] - '0';
+        trace->buffer = (BYTE*) malloc(TRACE_BUFFER_SIZE);
+    }
+    else if (c != EOF) {
+        ungetc(c, trace->file);
+    }
+}
+
+/*
+ * Replay a binary trace that is already in memory, without its magic
+ * number, its records in the given format version.  Nothing is copied so
+ * many readers can share one buffer.
+ */
+void iplc_sim_trace_memory(trace_t *trace, BYTE *data, size_t len, int version)
+{
+    bzero(trace, sizeof(trace_t));
+    trace->binary = TRUE;
+    trace->version = version;
+    trace->buffer = data;
+    trace->len = len;
+}
+
+/*
+ * Fetch the next instruction of the trace.  Returns 0 at the end.
+ */
+int iplc_sim_trace_next(trace_t *trace, iplc_inst_t *inst)
+{
+    const char *line, *eol;
+    ssize_t len;
+    uint reg;
+
+    if (!trace->binary && trace->map) {
+        if (trace->pos >= trace->len)
+            return 0;
+        line = trace->map + trace->pos;
+        eol = (const char*) memchr(line, '\n', trace->len - trace->pos);
+        if (eol == NULL)
+            eol = trace->map + trace->len;
+        trace->pos = eol - trace->map + 1;
+        iplc_sim_decode_line(line, eol, inst);
+        return 1;
+    }
+
+    if (!trace->binary) {
+        if ((len = getline(&trace->line, &trace->line_size, trace->file)) < 0)
+            return 0;
+        iplc_sim_decode_line(trace->line, trace->line + len, inst);
+        return 1;
+    }
+
+    // keep a whole record in the buffer
+    if (trace->file && !trace->map && trace->len - trace->pos < TRACE_RECORD_MAX) {
+        memmove(trace->buffer, trace->buffer + trace->pos, trace->len - trace->pos);
+        trace->len -= trace->pos;
+        trace->pos = 0;
+        trace->len += fread(trace->buffer + trace->len, 1, TRACE_BUFFER_SIZE - trace->len, trace->file);
+    }
+    if (trace->pos >= trace->len)
+        return 0;
+
+    inst->op = trace->buffer[trace->pos++];
+    if (inst->op >= OP_COUNT) {
+        printf("Bad opcode %d in binary trace \n", inst->op);
+        exit(-1);
+    }
+    trace->last_address += 4 + iplc_sim_trace_get_signed(trace);
+    inst->instruction_address = trace->last_address;
+    inst->data_address = 0;
+    inst->dest_reg = inst->reg1 = inst->reg2_or_constant = -1;
+
+    switch (inst->op) {
+        case OP_ADD:
+        case OP_ADDI:
+        case OP_ADDIU:
+        case OP_ADDU:
+        case OP_SLL:
+        case OP_ORI:
+            inst->dest_reg = iplc_sim_trace_get_signed(trace);
+            inst->reg1 = iplc_sim_trace_get_signed(trace);
+            inst->reg2_or_constant = iplc_sim_trace_get_signed(trace);
+            break;
+        case OP_LUI:
+            inst->dest_reg = iplc_sim_trace_get_signed(trace);
+            break;
+        case OP_LW:
+        case OP_SW:
+            reg = iplc_sim_trace_get_signed(trace);
+            if (inst->op == OP_LW)
+                inst->dest_reg = reg;
+            else
+                inst->reg1 = reg;
+            if (trace->version >= 2)
+                inst->reg2_or_constant = iplc_sim_trace_get_signed(trace);
+            trace->last_data_address += iplc_sim_trace_get_signed(trace);
+            inst->data_address = trace->last_data_address;
+            break;
+        case OP_BEQ:
+            if (trace->version >= 2) {
+                inst->reg1 = iplc_sim_trace_get_signed(trace);
+                inst->reg2_or_constant = iplc_sim_trace_get_signed(trace);
+            }
+            break;
+    }
+    return 1;
+}
+
+void iplc_sim_trace_close(trace_t *trace)
+{
+    if (trace->map)
+        munmap(trace->map, trace->map_size);
+    else
+        free(trace->buffer);
+    free(trace->line);
+    fclose(trace->file);
+}
+
+/*
+ * Write the binary record for one instruction at out and return the end of
+ * the record.  last_address and last_data_address carry the delta state.
+ */
+BYTE *iplc_sim_trace_encode(iplc_inst_t *inst, BYTE *out,
+                            unsigned int *last_address, unsigned int *last_data_address)
+{
+    *out++ = (BYTE) inst->op;
+    iplc_sim_trace_put_signed(&out, inst->instruction_address - *last_address - 4);
+    *last_address = inst->instruction_address;
+
+    switch (inst->op) {
+        case OP_ADD:
+        case OP_ADDI:
+        case OP_ADDIU:
+        case OP_ADDU:
+        case OP_SLL:
+        case OP_ORI:
+            iplc_sim_trace_put_signed(&out, inst->dest_reg);
+            iplc_sim_trace_put_signed(&out, inst->reg1);
+            iplc_sim_trace_put_signed(&out, inst->reg2_or_constant);
+            break;
+        case OP_LUI:
+            iplc_sim_trace_put_signed(&out, inst->dest_reg);
+            break;
+        case OP_LW:
+        case OP_SW:
+            iplc_sim_trace_put_signed(&out, inst->op == OP_LW ? inst->dest_reg : inst->reg1);
+            iplc_sim_trace_put_signed(&out, inst->reg2_or_constant);
+            iplc_sim_trace_put_signed(&out, inst->data_address - *last_data_address);
+            *last_data_address = inst->data_address;
+            break;
+        case OP_BEQ:
+            iplc_sim_trace_put_signed(&out, inst->reg1);
+            iplc_sim_trace_put_signed(&out, inst->reg2_or_constant);
+            break;
+    }
+    return out;
+}
+
+/*
+ * Decode a whole trace once and write it out in the binary format.
+ * Returns the number of instructions written.
+ */
+int iplc_sim_trace_convert(trace_t *trace, char *out_name)
+{
+    FILE *out = fopen(out_name, "wb");
+    iplc_inst_t inst;
+    BYTE record[TRACE_RECORD_MAX];
+    BYTE *end;
+    unsigned int last_address = 0, last_data_address = 0;
+    unsigned long bytes = sizeof(TRACE_MAGIC) - 1;
+    int count = 0;
+
+    if (out == NULL) {
+        printf("fopen failed for %s file\n", out_name);
+        exit(-1);
+    }
+    fwrite(TRACE_MAGIC, 1, sizeof(TRACE_MAGIC) - 1, out);
+
+    while (iplc_sim_trace_next(trace, &inst)) {
+        end = iplc_sim_trace_encode(&inst, record, &last_address, &last_data_address);
+        fwrite(record, 1, end - record, out);
+        bytes += end - record;
+        count++;
+    }
+
+    fclose(out);
+    printf("Converted %d instructions into %lu bytes (%.2f bytes/instruction) \n",
+           count, bytes, count ? (double)bytes / count : 0.0);
+    return count;
+}
+
+/************************************************************************************************/
+/* Generator Functions **************************************************************************/
+/************************************************************************************************/
+
+/*
+ * Look up a pattern by name, -1 if there is no such pattern.
+ */
+int iplc_sim_parse_pattern(char *name)
+{
+    int i;
+
+    for (i = 0; i < PATTERN_COUNT; i++) {
+        if (strcmp(name, pattern_names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/*
+ * Same xorshift generator the random replacement policy uses.
+ */
+uint64_t iplc_sim_generate_random(generator_t *gen)
+{
+    uint64_t x = gen->random_state;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    gen->random_state = x;
+    return x;
+}
+
+/*
+ * Start a synthetic trace of count instructions.  param is the stride in
+ * bytes, the working set in bytes, the loop body length or the call depth,
+ * depending on the pattern; 0 picks the pattern's default.
+ */
+void iplc_sim_generate_init(generator_t *gen, int pattern, unsigned long count,
+                            unsigned int param, uint64_t seed)
+{
+    unsigned int i, j, t;
+
+    bzero(gen, sizeof(generator_t));
+    gen->pattern = pattern;
+    gen->remaining = count;
+    gen->random_state = seed ? seed : 0x9e3779b97f4a7c15ULL;
+
+    switch (pattern) {
+        case PATTERN_SEQUENTIAL:
+            gen->param = 4;
+            break;
+        case PATTERN_STRIDE:
+            gen->param = param ? param : 64;
+            break;
+        case PATTERN_RANDOM:
+            gen->param = param ? param : 65536;
+            break;
+        case PATTERN_CHASE:
+            gen->param = param ? param : 1048576;
+            break;
+        case PATTERN_LOOP:
+            gen->param = param ? param : 8;
+            break;
+        case PATTERN_CALL:
+            gen->param = param ? param : 4;
+            break;
+    }
+    if (pattern == PATTERN_LOOP && (gen->param < 2 || gen->param > GENERATE_BLOCK_MAX - 2)) {
+        printf("Loop bodies need 2 to %d instructions \n", GENERATE_BLOCK_MAX - 2);
+        exit(-1);
+    }
+    if (pattern == PATTERN_CALL && (gen->param < 1 || gen->param > GENERATE_CALL_MAX)) {
+        printf("Call depths need to be 1 to %d \n", GENERATE_CALL_MAX);
+        exit(-1);
+    }
+
+    if (pattern == PATTERN_CHASE) {
+        // one cycle through every node in a random order (Sattolo's shuffle)
+        gen->nodes = gen->param / GENERATE_NODE_SIZE ? gen->param / GENERATE_NODE_SIZE : 1;
+        gen->chain = (unsigned int*) malloc(gen->nodes * sizeof(unsigned int));
+        for (i = 0; i < gen->nodes; i++)
+            gen->chain[i] = i;
+        for (i = gen->nodes - 1; i > 0; i--) {
+            j = (unsigned int) (iplc_sim_generate_random(gen) % i);
+            t = gen->chain[i];
+            gen->chain[i] = gen->chain[j];
+            gen->chain[j] = t;
+        }
+    }
+}
+
+void iplc_sim_generate_free(generator_t *gen)
+{
+    free(gen->chain);
+}
+
+/*
+ * Append one instruction to the block being generated.
+ */
+iplc_inst_t *iplc_sim_generate_emit(generator_t *gen, int op, unsigned int pc,
+                                    int dest_reg, int reg1, int reg2_or_constant)
+{
+    iplc_inst_t *inst = &gen->block[gen->block_len++];
+
+    inst->instruction_address = pc;
+    inst->data_address = 0;
+    inst->op = op;
+    inst->dest_reg = dest_reg;
+    inst->reg1 = reg1;
+    inst->reg2_or_constant = reg2_or_constant;
+    return inst;
+}
+
+/*
+ * One function of the call pattern at the given depth, calling the next
+ * one down about half the time.  The caller resumes at return_pc.
+ */
+void iplc_sim_generate_call(generator_t *gen, unsigned int depth, unsigned int return_pc)
+{
+    unsigned int pc = GENERATE_CODE + GENERATE_FUNCTION_SIZE * depth;
+    unsigned int sp = GENERATE_STACK - 8 * depth;
+
+    iplc_sim_generate_emit(gen, OP_ADDI, pc, 29, 29, -8);
+    iplc_sim_generate_emit(gen, OP_SW, pc + 4, -1, 31, 29)->data_address = sp + 4;
+    iplc_sim_generate_emit(gen, OP_ADDU, pc + 8, 2, 4, 5);
+    iplc_sim_generate_emit(gen, OP_SLL, pc + 12, 3, 2, 2);
+    // branch over the call, or fall through into it
+    iplc_sim_generate_emit(gen, OP_BEQ, pc + 16, -1, 4, 5)->data_address = pc + 24;
+    if (depth < gen->param && iplc_sim_generate_random(gen) & 1) {
+        iplc_sim_generate_emit(gen, OP_JAL, pc + 20, -1, -1, -1)->data_address =
+            GENERATE_CODE + GENERATE_FUNCTION_SIZE * (depth + 1);
+        iplc_sim_generate_call(gen, depth + 1, pc + 24);
+    }
+    iplc_sim_generate_emit(gen, OP_LW, pc + 24, 31, -1, 29)->data_address = sp + 4;
+    iplc_sim_generate_emit(gen, OP_ADDI, pc + 28, 29, 29, 8);
+    iplc_sim_generate_emit(gen, OP_JR, pc + 32, -1, 31, -1)->data_address = return_pc;
+}
+
+/*
+ * Generate the next iteration of the pattern's loop into gen->block.
+ * Branches and jumps carry their target in data_address, only the text
+ * writer looks at it.
+ */
+void iplc_sim_generate_block(generator_t *gen)
+{
+    unsigned int pc = GENERATE_CODE;
+    unsigned int i, address;
+
+    gen->block_len = gen->block_pos = 0;
+
+    switch (gen->pattern) {
+        case PATTERN_SEQUENTIAL:
+        case PATTERN_STRIDE:
+            // a copy loop over two arrays, restarted once it walks off the end
+            iplc_sim_generate_emit(gen, OP_LW, pc, 8, -1, 9)->data_address = GENERATE_DATA + gen->cursor;
+            iplc_sim_generate_emit(gen, OP_ADDU, pc + 4, 10, 10, 8);
+            iplc_sim_generate_emit(gen, OP_SW, pc + 8, -1, 10, 11)->data_address =
+                GENERATE_DATA + GENERATE_ARRAY_SIZE + gen->cursor;
+            iplc_sim_generate_emit(gen, OP_ADDIU, pc + 12, 9, 9, gen->param);
+            iplc_sim_generate_emit(gen, OP_BEQ, pc + 16, -1, 9, 12)->data_address = pc;
+            gen->cursor += gen->param;
+            if (gen->cursor >= GENERATE_ARRAY_SIZE) {
+                // the branch falls through this time
+                iplc_sim_generate_emit(gen, OP_J, pc + 20, -1, -1, -1)->data_address = pc;
+                gen->cursor = 0;
+            }
+            break;
+
+        case PATTERN_RANDOM:
+            // read-modify-write of random words of the working set
+            address = GENERATE_DATA + (unsigned int) (iplc_sim_generate_random(gen) % gen->param) / 4 * 4;
+            iplc_sim_generate_emit(gen, OP_ADDU, pc, 8, 8, 13);
+            iplc_sim_generate_emit(gen, OP_LW, pc + 4, 9, -1, 8)->data_address = address;
+            iplc_sim_generate_emit(gen, OP_ADDIU, pc + 8, 9, 9, 1);
+            iplc_sim_generate_emit(gen, OP_SW, pc + 12, -1, 9, 8)->data_address = address;
+            iplc_sim_generate_emit(gen, OP_BEQ, pc + 16, -1, 10, 11)->data_address = pc;
+            break;
+
+        case PATTERN_CHASE:
+            // every load depends on the one before it
+            iplc_sim_generate_emit(gen, OP_LW, pc, 8, -1, 8)->data_address =
+                GENERATE_DATA + gen->cursor * GENERATE_NODE_SIZE;
+            iplc_sim_generate_emit(gen, OP_ADDIU, pc + 4, 9, 9, 1);
+            iplc_sim_generate_emit(gen, OP_BEQ, pc + 8, -1, 8, 0)->data_address = pc;
+            gen->cursor = gen->chain[gen->cursor];
+            break;
+
+        case PATTERN_LOOP:
+            // a tight loop of param instructions taken GENERATE_TRIPS times, then the outer loop
+            for (i = 0; i < gen->param - 1; i++, pc += 4) {
+                if (i % 4 == 3)
+                    iplc_sim_generate_emit(gen, OP_LW, pc, 8 + i % 8, -1, 16)->data_address =
+                        GENERATE_DATA + 4 * i;
+                else
+                    iplc_sim_generate_emit(gen, i % 4 == 1 ? OP_SLL : OP_ADDU, pc, 8 + i % 8, 8 + (i + 1) % 8, 2);
+            }
+            iplc_sim_generate_emit(gen, OP_BEQ, pc, -1, 17, 18)->data_address = GENERATE_CODE;
+            if (++gen->cursor == GENERATE_TRIPS) {
+                iplc_sim_generate_emit(gen, OP_ADDIU, pc + 4, 19, 19, 1);
+                iplc_sim_generate_emit(gen, OP_J, pc + 8, -1, -1, -1)->data_address = GENERATE_CODE;
+                gen->cursor = 0;
+            }
+            break;
+
+        case PATTERN_CALL:
+            // the main loop at depth 0 calls depth 1
+            iplc_sim_generate_emit(gen, OP_ORI, pc, 4, 0, 5);
+            iplc_sim_generate_emit(gen, OP_JAL, pc + 4, -1, -1, -1)->data_address =
+                GENERATE_CODE + GENERATE_FUNCTION_SIZE;
+            iplc_sim_generate_call(gen, 1, pc + 8);
+            iplc_sim_generate_emit(gen, OP_J, pc + 8, -1, -1, -1)->data_address = pc;
+            break;
+    }
+}
+
+/*
+ * Fetch the next generated instruction.  Returns 0 once count have been
+ * generated.
+ */
+int iplc_sim_generate_next(generator_t *gen, iplc_inst_t *inst)
+{
+    if (gen->remaining == 0)
+        return 0;
+    if (gen->block_pos == gen->block_len)
+        iplc_sim_generate_block(gen);
+    *inst = gen->block[gen->block_pos++];
+    gen->remaining--;
+    return 1;
+}
+
+/*
+ * Write one instruction as a line of a text trace.  LW and SW print
+ * reg2_or_constant as their base register.
+ */
+void iplc_sim_trace_print(FILE *out, iplc_inst_t *inst)
+{
+    const char *name = opcode_names[inst->op];
+
+    fprintf(out, "0x%08x  ", inst->instruction_address);
+    switch (inst->op) {
+        case OP_ADD:
+        case OP_ADDU:
+            fprintf(out, "%s $%d, $%d, $%d\n", name, inst->dest_reg, inst->reg1, inst->reg2_or_constant);
+            break;
+        case OP_ADDI:
+        case OP_ADDIU:
+        case OP_SLL:
+        case OP_ORI:
+            fprintf(out, "%s $%d, $%d, %d\n", name, inst->dest_reg, inst->reg1, inst->reg2_or_constant);
+            break;
+        case OP_LUI:
+            fprintf(out, "%s $%d, %d\n", name, inst->dest_reg, inst->reg2_or_constant);
+            break;
+        case OP_LW:
+        case OP_SW:
+            fprintf(out, "%s $%d, 0($%d): %x\n", name, inst->op == OP_LW ? inst->dest_reg : inst->reg1,
+                    inst->reg2_or_constant, inst->data_address);
+            break;
+        case OP_BEQ:
+            fprintf(out, "%s $%d, $%d, %d\n", name, inst->reg1, inst->reg2_or_constant,
+                    (int) (inst->data_address - inst->instruction_address - 4));
+            break;
+        case OP_J:
+        case OP_JAL:
+            fprintf(out, "%s 0x%08x\n", name, inst->data_address);
+            break;
+        case OP_JR:
+            fprintf(out, "%s $%d\n", name, inst->reg1);
+            break;
+        default:
+            fprintf(out, "%s\n", name);
+            break;
+    }
+}
+
+/*
+ * Write a synthetic text trace to out_name.  spec is
+ * pattern[,count[,param[,seed]]].
+ */
+void iplc_sim_generate_trace(char *spec, char *out_name)
+{
+    char name[32];
+    unsigned long count = GENERATE_COUNT;
+    unsigned int param = 0;
+    unsigned long long seed = 0;
+    int pattern;
+    generator_t gen;
+    iplc_inst_t inst;
+    FILE *out;
+
+    if (sscanf(spec, "%31[^,],%lu,%u,%llu", name, &count, &param, &seed) < 1 ||
+        (pattern = iplc_sim_parse_pattern(name)) < 0) {
+        printf("Bad generator, expected sequential|stride|random|chase|loop|call[,count[,param[,seed]]]: %s \n",
+               spec);
+        exit(-1);
+    }
+    if ((out = fopen(out_name, "w")) == NULL) {
+        printf("fopen failed for %s file\n", out_name);
+        exit(-1);
+    }
+
+    iplc_sim_generate_init(&gen, pattern, count, param, seed);
+    while (iplc_sim_generate_next(&gen, &inst))
+        iplc_sim_trace_print(out, &inst);
+    iplc_sim_generate_free(&gen);
+
+    fclose(out);
+    printf("Generated %lu %s instructions into %s \n", count, pattern_names[pattern], out_name);
+}
+
+/************************************************************************************************/
+/* Event Log Functions **************************************************************************/
+/************************************************************************************************/
+
+/*
+ * Start an event log.  Each record is the event kind followed by the
+ * cycle, PC and address as varint deltas against the previous record, the
+ * same encoding the binary trace uses.
+ */
+event_log_t *iplc_sim_event_open(char *name)
+{
+    event_log_t *log = (event_log_t*) calloc(1, sizeof(event_log_t));
+
+    log->file = fopen(name, "wb");
+    if (log->file == NULL) {
+        printf("fopen failed for %s file\n", name);
+        exit(-1);
+    }
+    fwrite(EVENT_MAGIC, 1, sizeof(EVENT_MAGIC) - 1, log->file);
+    return log;
+}
+
+void iplc_sim_event_record(event_log_t *log, int kind, unsigned int cycle,
+                           unsigned int pc, unsigned int address)
+{
+    BYTE *out;
+
+    if (sizeof(log->buffer) - log->len < EVENT_RECORD_MAX) {
+        fwrite(log->buffer, 1, log->len, log->file);
+        log->len = 0;
+    }
+    out = log->buffer + log->len;
+    *out++ = (BYTE) kind;
+    iplc_sim_trace_put_varint(&out, cycle - log->last_cycle);
+    iplc_sim_trace_put_signed(&out, (int) (pc - log->last_pc));
+    iplc_sim_trace_put_signed(&out, (int) (address - log->last_address));
+    log->len = out - log->buffer;
+    log->last_cycle = cycle;
+    log->last_pc = pc;
+    log->last_address = address;
+    log->count++;
+}
+
+void iplc_sim_event_close(event_log_t *log)
+{
+    fwrite(log->buffer, 1, log->len, log->file);
+    fclose(log->file);
+    free(log);
+}
+
+/*
+ * Print an event log as text, one "cycle pc kind address" line per event.
+ */
+long iplc_sim_event_decode(char *name)
+{
+    FILE *file = fopen(name, "rb");
+    trace_t log;
+    struct stat st;
+    BYTE *data;
+    unsigned int cycle = 0, pc = 0, address = 0;
+    long count = 0;
+    int kind;
+
+    if (file == NULL || fstat(fileno(file), &st) < 0) {
+        printf("fopen failed for %s file\n", name);
+        exit(-1);
+    }
+    data = (BYTE*) malloc(st.st_size + 1);
+    if (fread(data, 1, st.st_size, file) != (size_t) st.st_size ||
+        st.st_size < (off_t) sizeof(EVENT_MAGIC) - 1 ||
+        memcmp(data, EVENT_MAGIC, sizeof(EVENT_MAGIC) - 1) != 0) {
+        printf("%s is not an event log \n", name);
+        exit(-1);
+    }
+    fclose(file);
+
+    // the records are read through an in-memory binary trace
+    iplc_sim_trace_memory(&log, data, st.st_size, TRACE_VERSION);
+    log.pos = sizeof(EVENT_MAGIC) - 1;
+    while (log.pos < log.len) {
+        kind = log.buffer[log.pos++];
+        if (kind >= EVENT_COUNT) {
+            printf("Bad event kind %d \n", kind);
+            exit(-1);
+        }
+        cycle += iplc_sim_trace_get_varint(&log);
+        pc += iplc_sim_trace_get_signed(&log);
+        address += iplc_sim_trace_get_signed(&log);
+        printf("%u 0x%x %s 0x%x\n", cycle, pc, event_names[kind], address);
+        count++;
+    }
+    free(data);
+    return count;
+}
+
+/************************************************************************************************/
+/* Checkpoint Functions *************************************************************************/
+/************************************************************************************************/
+
+/*
+ * Write size bytes of data to the checkpoint, or read them back.
+ */
+void iplc_sim_checkpoint_io(FILE *file, void *data, size_t size, int save)
+{
+    if (size && (save ? fwrite(data, 1, size, file) : fread(data, 1, size, file)) != size) {
+        printf(save ? "Checkpoint write failed \n" : "Truncated checkpoint \n");
+        exit(-1);
+    }
+}
+
+/*
+ * The arrays of one cache level.  When restoring, cache holds the saved
+ * cache_t and kept the level iplc_sim_init() built, whose arrays are
+ * reused; when saving both are the same level.  The seen set of the 3C
+ * shadow may have grown past its starting size, so it is resized.
+ */
+void iplc_sim_checkpoint_cache(FILE *file, cache_t *cache, cache_t *kept, int save)
+{
+    size_t sets = (size_t) 1 << cache->index, lines = sets * cache->assoc;
+
+    cache->name = kept->name;
+    cache->latency = kept->latency;
+    cache->arena = kept->arena;
+    cache->arena_size = kept->arena_size;
+    cache->tags = kept->tags;
+    cache->tags16 = kept->tags16;
+    cache->valid = kept->valid;
+    cache->rank = kept->rank;
+    cache->plru = kept->plru;
+    cache->dirty = kept->dirty;
+    cache->shadow = kept->shadow;
+    cache->prefetch = kept->prefetch;
+    cache->coherence = kept->coherence;
+    cache->touched = kept->touched;
+
+    if (cache->tags16)
+        iplc_sim_checkpoint_io(file, cache->tags16, lines * sizeof(uint16_t), save);
+    else
+        iplc_sim_checkpoint_io(file, cache->tags, lines * sizeof(uint), save);
+    iplc_sim_checkpoint_io(file, cache->valid, sets * sizeof(uint64_t), save);
+    iplc_sim_checkpoint_io(file, cache->rank, sets * cache->rank_stride, save);
+    if (cache->plru)
+        iplc_sim_checkpoint_io(file, cache->plru, sets * sizeof(uint64_t), save);
+    if (cache->dirty)
+        iplc_sim_checkpoint_io(file, cache->dirty, sets * sizeof(uint64_t), save);
+    if (cache->shadow) {
+        shadow_t *shadow = cache->shadow;
+        shadow_slot_t *slots = shadow->slots;
+        shadow_node_t *nodes = shadow->nodes;
+
+        iplc_sim_checkpoint_io(file, shadow, sizeof(shadow_t), save);
+        shadow->slots = save ? slots : (shadow_slot_t*) realloc(slots, (shadow->mask + 1) * sizeof(shadow_slot_t));
+        shadow->nodes = nodes;
+        iplc_sim_checkpoint_io(file, shadow->slots, (shadow->mask + 1) * sizeof(shadow_slot_t), save);
+        iplc_sim_checkpoint_io(file, shadow->nodes, shadow->capacity * sizeof(shadow_node_t), save);
+    }
+    if (cache->prefetch) {
+        prefetch_t *prefetch = cache->prefetch;
+        uint64_t *prefetched = prefetch->prefetched;
+        unsigned int *ready = prefetch->ready;
+        int latency = prefetch->latency;
+
+        iplc_sim_checkpoint_io(file, prefetch, sizeof(prefetch_t), save);
+        prefetch->prefetched = prefetched;
+        prefetch->ready = ready;
+        prefetch->latency = latency;
+        iplc_sim_checkpoint_io(file, prefetch->prefetched, sets * sizeof(uint64_t), save);
+        iplc_sim_checkpoint_io(file, prefetch->ready, lines * sizeof(unsigned int), save);
+    }
+}
+
+/*
+ * Everything the simulator points to, the same way round as
+ * iplc_sim_checkpoint_cache().  A restored write buffer or MSHR file that
+ * was saved empty (size 0) reads nothing and starts empty.
+ */
+void iplc_sim_checkpoint_arrays(FILE *file, iplc_sim_t *sim, iplc_sim_t *kept, int save)
+{
+    size_t entries = (size_t) 1 << sim->predictor_bits;
+    int i;
+
+    sim->l1i = &sim->l1[0];
+    sim->l1d = sim->split_l1 ? &sim->l1[1] : &sim->l1[0];
+    iplc_sim_checkpoint_cache(file, &sim->l1[0], &kept->l1[0], save);
+    if (sim->split_l1)
+        iplc_sim_checkpoint_cache(file, &sim->l1[1], &kept->l1[1], save);
+    for (i = 0; i < sim->lower_levels; i++)
+        iplc_sim_checkpoint_cache(file, &sim->lower[i], &kept->lower[i], save);
+    for (i = 0; i < TLB_COUNT; i++) {
+        if (sim->tlb[i].assoc)
+            iplc_sim_checkpoint_cache(file, &sim->tlb[i], &kept->tlb[i], save);
+    }
+
+    sim->write_buffer_block = kept->write_buffer_block;
+    sim->write_buffer_ready = kept->write_buffer_ready;
+    sim->mshr_block = kept->mshr_block;
+    sim->mshr_ready = kept->mshr_ready;
+    sim->bimodal_table = kept->bimodal_table;
+    sim->gshare_table = kept->gshare_table;
+    sim->chooser_table = kept->chooser_table;
+    sim->btb_tags = kept->btb_tags;
+    sim->btb_targets = kept->btb_targets;
+    sim->events = kept->events;
+    sim->profile = kept->profile;
+    sim->interval_file = kept->interval_file;
+    sim->multicore = kept->multicore;
+    sim->coherence_lost = kept->coherence_lost;
+
+    iplc_sim_checkpoint_io(file, sim->write_buffer_block, sim->write_buffer_size * sizeof(unsigned int), save);
+    iplc_sim_checkpoint_io(file, sim->write_buffer_ready, sim->write_buffer_size * sizeof(unsigned int), save);
+    iplc_sim_checkpoint_io(file, sim->mshr_block, sim->mshrs * sizeof(unsigned int), save);
+    iplc_sim_checkpoint_io(file, sim->mshr_ready, sim->mshrs * sizeof(unsigned int), save);
+    if (sim->bimodal_table)
+        iplc_sim_checkpoint_io(file, sim->bimodal_table, entries, save);
+    if (sim->gshare_table)
+        iplc_sim_checkpoint_io(file, sim->gshare_table, entries, save);
+    if (sim->chooser_table)
+        iplc_sim_checkpoint_io(file, sim->chooser_table, entries, save);
+    if (sim->btb_bits) {
+        iplc_sim_checkpoint_io(file, sim->btb_tags, ((size_t) 1 << sim->btb_bits) * sizeof(uint), save);
+        iplc_sim_checkpoint_io(file, sim->btb_targets, ((size_t) 1 << sim->btb_bits) * sizeof(uint), save);
+    }
+}
+
+/*
+ * Write the whole state of sim to a checkpoint, records trace
+ * instructions in.  The pipeline is saved as it is, not drained, so a
+ * restore goes on exactly as this run would have.
+ */
+void iplc_sim_checkpoint_save(iplc_sim_t *sim, char *name, trace_t *trace, unsigned long records)
+{
+    FILE *file = fopen(name, "wb");
+    checkpoint_header_t header;
+
+    if (file == NULL) {
+        printf("fopen failed for %s file\n", name);
+        exit(-1);
+    }
+    bzero(&header, sizeof(header));
+    header.sim_size = sizeof(iplc_sim_t);
+    header.trace_binary = trace->binary;
+    header.records = records;
+    if (trace->map) {
+        header.trace_size = trace->map_size;
+        header.trace_pos = trace->pos;
+    }
+    header.last_address = trace->last_address;
+    header.last_data_address = trace->last_data_address;
+
+    iplc_sim_checkpoint_io(file, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC) - 1, TRUE);
+    iplc_sim_checkpoint_io(file, &header, sizeof(header), TRUE);
+    iplc_sim_checkpoint_io(file, sim, sizeof(iplc_sim_t), TRUE);
+    iplc_sim_checkpoint_arrays(file, sim, sim, TRUE);
+    if (fclose(file) != 0) {
+        printf("Checkpoint write failed \n");
+        exit(-1);
+    }
+    if (sim->verbose >= VERBOSE_CONFIG)
+        printf("Checkpoint %s written after %lu instructions \n", name, records);
+}
+
+/*
+ * What a checkpoint can not be restored into, or NULL if sim is built
+ * like saved.  Everything that shapes the saved arrays has to match; the
+ * latencies, forwarding, memory ports and ALUs, the static prediction, the
+ * page walk and sampling may change, and a write buffer or MSHRs may be added.
+ */
+const char *iplc_sim_checkpoint_mismatch(iplc_sim_t *sim, iplc_sim_t *saved)
+{
+    int i;
+
+    if (sim->split_l1 != saved->split_l1 || sim->lower_levels != saved->lower_levels ||
+        sim->inclusion != saved->inclusion)
+        return "hierarchy";
+    for (i = 0; i < 2 + MAX_LOWER_LEVELS; i++) {
+        cache_t *a = i < 2 ? &sim->l1[i] : &sim->lower[i - 2];
+        cache_t *b = i < 2 ? &saved->l1[i] : &saved->lower[i - 2];
+
+        if (a->index != b->index || a->blocksize != b->blocksize || a->assoc != b->assoc)
+            return "cache geometry";
+    }
+    if (sim->cache_policy != saved->cache_policy)
+        return "replacement policy";
+    if (sim->predictor != saved->predictor || sim->predictor_bits != saved->predictor_bits ||
+        sim->history_bits != saved->history_bits || sim->btb_bits != saved->btb_bits)
+        return "branch predictor";
+    if (sim->write_model != saved->write_model || sim->write_through != saved->write_through ||
+        sim->write_no_allocate != saved->write_no_allocate)
+        return "write policy";
+    if (saved->write_buffer_size && sim->write_buffer_size != saved->write_buffer_size)
+        return "write buffer";
+    if (sim->prefetcher != saved->prefetcher || sim->prefetch_degree != saved->prefetch_degree)
+        return "prefetcher";
+    if (saved->mshrs && sim->mshrs != saved->mshrs)
+        return "MSHR count";
+    if (sim->classify_misses != saved->classify_misses)
+        return "miss classification";
+    if (sim->issue_width != saved->issue_width || sim->pipeline_depth != saved->pipeline_depth)
+        return "pipeline";
+    for (i = 0; i < TLB_COUNT; i++) {
+        if (sim->tlb[i].index != saved->tlb[i].index || sim->tlb[i].assoc != saved->tlb[i].assoc)
+            return "TLB geometry";
+    }
+    if (sim->page_bits != saved->page_bits)
+        return "page size";
+    return NULL;
+}
+
+/*
+ * Replace the state of sim, already set up by iplc_sim_init(), with a
+ * checkpoint, and move trace to the instruction after it.  sim keeps its
+ * own timing options, event log and profile.  Interval rows start over
+ * from the restore, as does sampling when its period changed.  Returns
+ * the trace instructions the checkpoint had run.
+ */
+unsigned long iplc_sim_checkpoint_restore(iplc_sim_t *sim, char *name, trace_t *trace)
+{
+    FILE *file = fopen(name, "rb");
+    char magic[sizeof(CHECKPOINT_MAGIC) - 1];
+    checkpoint_header_t header;
+    iplc_sim_t saved, now = *sim;
+    const char *mismatch;
+    iplc_inst_t inst;
+    unsigned long i;
+
+    if (file == NULL) {
+        printf("fopen failed for %s file\n", name);
+        exit(-1);
+    }
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+        memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0) {
+        printf("%s is not a checkpoint of this version \n", name);
+        exit(-1);
+    }
+    iplc_sim_checkpoint_io(file, &header, sizeof(header), FALSE);
+    if (header.sim_size != sizeof(iplc_sim_t)) {
+        printf("%s was written by a different build of the simulator \n", name);
+        exit(-1);
+    }
+    iplc_sim_checkpoint_io(file, &saved, sizeof(iplc_sim_t), FALSE);
+    if ((mismatch = iplc_sim_checkpoint_mismatch(sim, &saved)) != NULL) {
+        printf("%s has a different %s, only timing options may change \n", name, mismatch);
+        exit(-1);
+    }
+
+    *sim = saved;
+    iplc_sim_checkpoint_arrays(file, sim, &now, FALSE);
+    fclose(file);
+
+    sim->write_buffer_size = now.write_buffer_size;
+    sim->mshrs = now.mshrs;
+    sim->l1_latency = now.l1_latency;
+    sim->memory_latency = now.memory_latency;
+    sim->prefetch_latency = now.prefetch_latency;
+    sim->walk_latency = now.walk_latency;
+    sim->walk_through_cache = now.walk_through_cache;
+    sim->scoreboard = now.scoreboard;
+    sim->forwarding = now.forwarding;
+    sim->memory_ports = now.memory_ports;
+    sim->alus = now.alus;
+    sim->branch_predict_taken = now.branch_predict_taken;
+    sim->debug = now.debug;
+    sim->dump_pipeline = now.dump_pipeline;
+    sim->verbose = now.verbose;
+    sim->report_policy = now.report_policy;
+    sim->report_predictor = now.report_predictor;
+    sim->interval = now.interval;
+    if (sim->interval) {
+        iplc_sim_interval_snapshot(sim, &sim->interval_last);
+        sim->interval_index = 0;
+        sim->interval_next = sim->instruction_count + sim->interval;
+    }
+    else {
+        sim->interval_next = 0;
+    }
+    if (sim->sample_ff != now.sample_ff || sim->sample_warmup != now.sample_warmup ||
+        sim->sample_detail != now.sample_detail) {
+        sim->sample_ff = now.sample_ff;
+        sim->sample_warmup = now.sample_warmup;
+        sim->sample_detail = now.sample_detail;
+        sim->sample_position = sim->sample_start_cycles = sim->functional_branch = 0;
+        sim->sample_instructions = 0;
+        sim->sample_count = 0;
+        sim->sample_sum = sim->sample_sum_squares = 0.0;
+    }
+
+    // jump straight to the next record of the same mapped trace, or read up to it
+    if (trace->map && header.trace_size == trace->map_size && header.trace_binary == trace->binary) {
+        trace->pos = header.trace_pos;
+        trace->last_address = header.last_address;
+        trace->last_data_address = header.last_data_address;
+    }
+    else if (trace->map && header.trace_size) {
+        printf("%s was taken on a different trace \n", name);
+        exit(-1);
+    }
+    else {
+        for (i = 0; i < header.records; i++) {
+            if (!iplc_sim_trace_next(trace, &inst)) {
+                printf("The trace ends before the %lu instructions of %s \n", header.records, name);
+                exit(-1);
+            }
+        }
+    }
+    if (sim->verbose >= VERBOSE_CONFIG)
+        printf("Checkpoint %s restored after %lu instructions \n", name, header.records);
+    return header.records;
+}
+
+/************************************************************************************************/
+/* Sweep Functions ******************************************************************************/
+/************************************************************************************************/
+
+/*
+ * Parse a sweep parameter list.  Either a comma separated list of values
+ * ("1,2,4,8") or an inclusive range ("2:7").  Returns the number of values.
+ */
+int iplc_sim_sweep_parse_list(char *list, int *values)
+{
+    int count = 0, lo = 0, hi = 0;
+    char *token;
+
+    if (sscanf(list, "%d:%d", &lo, &hi) == 2) {
+        for (; lo <= hi && count < SWEEP_MAX_VALUES; lo++)
+            values[count++] = lo;
+    }
+    else {
+        for (token = strtok(list, ","); token && count < SWEEP_MAX_VALUES; token = strtok(NULL, ","))
+            values[count++] = atoi(token);
+    }
+
+    if (count == 0) {
+        printf("Bad sweep list: %s \n", list);
+        exit(-1);
+    }
+    return count;
+}
+
+/*
+ * Parse a comma separated list of replacement policy names.  Returns the
+ * number of policies.
+ */
+int iplc_sim_sweep_parse_policies(char *list, int *values)
+{
+    int count = 0;
+    char *token;
+
+    for (token = strtok(list, ","); token && count < SWEEP_MAX_VALUES; token = strtok(NULL, ",")) {
+        values[count] = iplc_sim_parse_policy(token);
+        if (values[count] < 0) {
+            printf("Unknown replacement policy: %s \n", token);
+            exit(-1);
+        }
+        count++;
+    }
+
+    if (count == 0) {
+        printf("Bad policy list \n");
+        exit(-1);
+    }
+    return count;
+}
+
+/*
+ * Allocate the LRU stacks for every (index, blocksize, assoc) we sweep.
+ */
+void iplc_sim_sweep_init()
+{
+    int x, b, a;
+    sweep_cache_t *config;
+
+    sweep_cache_count = sweep_index_count * sweep_blocksize_count * sweep_assoc_count;
+    sweep_caches = (sweep_cache_t*) calloc(sweep_cache_count, sizeof(sweep_cache_t));
+    config = sweep_caches;
+
+    for (x = 0; x < sweep_index_count; x++) {
+        for (b = 0; b < sweep_blocksize_count; b++) {
+            for (a = 0; a < sweep_assoc_count; a++, config++) {
+                // the LRU stacks of an index past 24 bits would not fit
+                if (sweep_index[x] > 24 || sweep_assoc[a] < 1 ||
+                    !iplc_sim_cache_geometry(sweep_index[x], sweep_blocksize[b], FALSE)) {
+                    printf("Bad sweep configuration: index %d blocksize %d assoc %d \n",
+                           sweep_index[x], sweep_blocksize[b], sweep_assoc[a]);
+                    exit(-1);
+                }
+
+                config->index = sweep_index[x];
+                config->blocksize = sweep_blocksize[b];
+                config->blockoffsetbits =
+                (int) rint((log( (double) (config->blocksize * 4) )/ log(2)));
+                config->assoc = sweep_assoc[a];
+                config->tags = (uint*) calloc((size_t) config->assoc << config->index, sizeof(uint));
+                config->depth = (int*) calloc(1 << config->index, sizeof(int));
+                config->distance = (long*) calloc(config->assoc, sizeof(long));
+            }
+        }
+    }
+}
+
+/*
+ * LRU stack update for one configuration.  Find the tag in its set's stack,
+ * record how deep it was, then move it to the MRU position.  Tag and index
+ * are split out exactly as iplc_sim_trap_address() does it.  Returns 1 on a
+ * hit, like iplc_sim_trap_address().
+ */
+int iplc_sim_sweep_access(sweep_cache_t *config, unsigned int address)
+{
+    uint index = (address >> config->blockoffsetbits) & ((1 << config->index) - 1);
+    uint tag = address >> (config->blockoffsetbits + config->index);
+    uint *tags = &config->tags[(size_t) index * config->assoc];
+    int depth = config->depth[index];
+    int d, hit;
+
+    config->access++;
+    for (d = 0; d < depth && tags[d] != tag; d++)
+        ;
+
+    hit = d < depth;
+    if (hit) {
+        config->distance[d]++;
+    }
+    else {
+        config->miss++;
+        // new tag, the LRU entry falls off the bottom of a full stack
+        if (depth < config->assoc)
+            config->depth[index]++;
+        else
+            d = depth - 1;
+    }
+
+    memmove(&tags[1], &tags[0], d * sizeof(uint));
+    tags[0] = tag;
+
+    return hit;
+}
+
+/*
+ * Feed one trace instruction to every configuration in the same order the
+ * pipeline traps addresses: the fetch first, then every push of the
+ * pipeline (one normally, CACHE_MISS_DELAY on an instruction miss) lets the
+ * LW/SW that has reached MEM access its data.
+ */
+void iplc_sim_sweep_instruction(unsigned int address, int is_mem, unsigned int data_address)
+{
+    int c, slot;
+
+    for (c = 0; c < sweep_cache_count; c++) {
+        sweep_cache_t *config = &sweep_caches[c];
+
+        config->pushes += iplc_sim_sweep_access(config, address) ? 1 : CACHE_MISS_DELAY;
+
+        while (config->pending_count && config->pending_at[config->pending_head] <= config->pushes) {
+            iplc_sim_sweep_access(config, config->pending[config->pending_head]);
+            config->pending_head = (config->pending_head + 1) % SWEEP_DATA_LAG;
+            config->pending_count--;
+        }
+
+        if (is_mem) {
+            slot = (config->pending_head + config->pending_count++) % SWEEP_DATA_LAG;
+            config->pending[slot] = data_address;
+            config->pending_at[slot] = config->pushes + SWEEP_DATA_LAG;
+        }
+    }
+}
+
+/*
+ * Make one pass over the trace, decoding each instruction once for all of
+ * the configurations, then drain the pipeline like iplc_sim_finalize().
+ */
+void iplc_sim_sweep_run(trace_t *trace)
+{
+    iplc_inst_t inst;
+    int c;
+
+    while (iplc_sim_trace_next(trace, &inst)) {
+        iplc_sim_sweep_instruction(inst.instruction_address,
+                                   inst.op == OP_LW || inst.op == OP_SW, inst.data_address);
+    }
+
+    for (c = 0; c < sweep_cache_count; c++) {
+        sweep_cache_t *config = &sweep_caches[c];
+        for (; config->pending_count; config->pending_count--) {
+            iplc_sim_sweep_access(config, config->pending[config->pending_head]);
+            config->pending_head = (config->pending_head + 1) % SWEEP_DATA_LAG;
+        }
+    }
+}
+
+/*
+ * Print the miss ratio curve, one row per (index, blocksize, assoc), and
+ * the cumulative stack distance profile of each configuration's hits.
+ */
+void iplc_sim_sweep_finalize()
+{
+    int c, d;
+
+    printf("Miss Ratio Curve \n");
+    printf("%6s %10s %6s %12s %10s %10s %10s %10s   %s\n", "Index", "BlockSize", "Assoc",
+           "CacheSize", "Accesses", "Hits", "Misses", "MissRate", "HitsByStackDistance");
+
+    for (c = 0; c < sweep_cache_count; c++) {
+        sweep_cache_t *config = &sweep_caches[c];
+        unsigned long cache_size = (unsigned long) config->assoc * (1 << config->index) *
+            ((32 * config->blocksize) + 33 - config->index - config->blockoffsetbits);
+
+        printf("%6d %10d %6d %12lu %10ld %10ld %10ld %10f  ",
+               config->index, config->blocksize, config->assoc, cache_size,
+               config->access, config->access - config->miss, config->miss,
+               config->access ? (double)config->miss / (double)config->access : 0.0);
+        for (d = 0; d < config->assoc; d++)
+            printf(" %ld", config->distance[d]);
+        printf("\n");
+
+        free(config->tags);
+        free(config->depth);
+        free(config->distance);
+    }
+    free(sweep_caches);
+}
+
+/************************************************************************************************/
+/* Runner Functions *****************************************************************************/
+/************************************************************************************************/
+
+/*
+ * Decode the trace once into its binary form in memory.  A binary trace
+ * that is already mapped is used where it is, in its own format version.
+ */
+void iplc_sim_runner_load(trace_t *trace)
+{
+    iplc_inst_t inst;
+    size_t size = TRACE_BUFFER_SIZE;
+    unsigned int last_address = 0, last_data_address = 0;
+
+    if (trace->binary && trace->map) {
+        runner_trace = trace->buffer + trace->pos;
+        runner_trace_len = trace->len - trace->pos;
+        runner_trace_version = trace->version;
+        return;
+    }
+
+    runner_trace = (BYTE*) malloc(size);
+    while (iplc_sim_trace_next(trace, &inst)) {
+        if (size - runner_trace_len < TRACE_RECORD_MAX) {
+            size *= 2;
+            runner_trace = (BYTE*) realloc(runner_trace, size);
+        }
+        runner_trace_len = iplc_sim_trace_encode(&inst, runner_trace + runner_trace_len,
+                                                 &last_address, &last_data_address) - runner_trace;
+    }
+}
+
+/*
+ * Run one configuration over the shared trace on a private simulator.
+ */
+void iplc_sim_runner_run_job(runner_job_t *job)
+{
+    iplc_sim_t sim = runner_template;
+    trace_t trace;
+    iplc_inst_t inst;
+
+    sim.branch_predict_taken = job->branch_predict_taken;
+    sim.cache_policy = job->policy;
+
+    job->status = iplc_sim_init(&sim, job->index, job->blocksize, job->assoc);
+    job->cache_size = sim.l1i->size;
+    if (job->status < 0) {
+        iplc_sim_free(&sim);
+        return;
+    }
+
+    iplc_sim_trace_memory(&trace, runner_trace, runner_trace_len, runner_trace_version);
+    while (iplc_sim_trace_next(&trace, &inst))
+        iplc_sim_process_instruction(&sim, &inst);
+    iplc_sim_drain(&sim);
+
+    // with a split L1 the cache columns are the L1I and L1D together
+    job->cache_access = sim.l1i->access + (sim.split_l1 ? sim.l1d->access : 0);
+    job->cache_hit = sim.l1i->hit + (sim.split_l1 ? sim.l1d->hit : 0);
+    job->cache_miss = sim.l1i->miss + (sim.split_l1 ? sim.l1d->miss : 0);
+    job->cache_evictions = sim.l1i->evictions + (sim.split_l1 ? sim.l1d->evictions : 0);
+    job->pipeline_cycles = sim.pipeline_cycles;
+    job->instruction_count = sim.instruction_count;
+    if (sim.sample_detail) {
+        double half_width;
+
+        // sampled jobs report the extrapolated cycles for the whole trace
+        job->instruction_count = sim.sample_instructions;
+        job->pipeline_cycles = (unsigned int) (iplc_sim_sample_cpi(&sim, &half_width) * sim.sample_instructions + 0.5);
+    }
+    job->branch_count = sim.branch_count;
+    job->correct_branch_predictions = sim.correct_branch_predictions;
+    job->branch_mispredictions = sim.branch_mispredictions;
+    iplc_sim_free(&sim);
+}
+
+/*
+ * Next job for worker self, or -1 when every queue is empty.
+ */
+int iplc_sim_runner_take(int self)
+{
+    runner_queue_t *own = &runner_queues[self];
+    int job = -1, lo = 0, hi = 0, v;
+
+    pthread_mutex_lock(&own->lock);
+    if (own->head < own->tail)
+        job = own->head++;
+    pthread_mutex_unlock(&own->lock);
+    if (job >= 0)
+        return job;
+
+    for (v = 1; v < runner_threads && job < 0; v++) {
+        runner_queue_t *victim = &runner_queues[(self + v) % runner_threads];
+
+        pthread_mutex_lock(&victim->lock);
+        if (victim->head < victim->tail) {
+            lo = victim->head + (victim->tail - victim->head) / 2;
+            hi = victim->tail;
+            victim->tail = lo;
+            job = lo;
+        }
+        pthread_mutex_unlock(&victim->lock);
+    }
+
+    // only ever hold one lock at a time, the stolen range is ours already
+    if (job >= 0) {
+        pthread_mutex_lock(&own->lock);
+        own->head = lo + 1;
+        own->tail = hi;
+        pthread_mutex_unlock(&own->lock);
+    }
+    return job;
+}
+
+void *iplc_sim_runner_worker(void *arg)
+{
+    int self = (int) (intptr_t) arg;
+    int job;
+
+    while ((job = iplc_sim_runner_take(self)) >= 0)
+        iplc_sim_runner_run_job(&runner_jobs[job]);
+    return NULL;
+}
+
+/*
+ * Run every (index, blocksize, assoc, policy, branch prediction) combination
+ * of the sweep lists, spread over runner_threads threads.
+ */
+void iplc_sim_runner_run(trace_t *trace)
+{
+    pthread_t *threads;
+    int x, b, a, r, p, t, per_thread;
+    runner_job_t *job;
+
+    iplc_sim_runner_load(trace);
+
+    runner_job_count = sweep_index_count * sweep_blocksize_count * sweep_assoc_count *
+                       sweep_policy_count * sweep_branch_count;
+    runner_jobs = (runner_job_t*) calloc(runner_job_count, sizeof(runner_job_t));
+    job = runner_jobs;
+    for (x = 0; x < sweep_index_count; x++) {
+        for (b = 0; b < sweep_blocksize_count; b++) {
+            for (a = 0; a < sweep_assoc_count; a++) {
+                for (r = 0; r < sweep_policy_count; r++) {
+                    for (p = 0; p < sweep_branch_count; p++, job++) {
+                        if (sweep_assoc[a] < 1 ||
+                            !iplc_sim_cache_geometry(sweep_index[x], sweep_blocksize[b], FALSE)) {
+                            printf("Bad sweep configuration: index %d blocksize %d assoc %d \n",
+                                   sweep_index[x], sweep_blocksize[b], sweep_assoc[a]);
+                            exit(-1);
+                        }
+                        job->index = sweep_index[x];
+                        job->blocksize = sweep_blocksize[b];
+                        job->assoc = sweep_assoc[a];
+                        job->policy = sweep_policy[r];
+                        job->branch_predict_taken = sweep_branch[p];
+                    }
+                }
+            }
+        }
+    }
+
+    if (runner_threads <= 0)
+        runner_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (runner_threads > runner_job_count)
+        runner_threads = runner_job_count;
+    if (runner_threads < 1)
+        runner_threads = 1;
+
+    runner_queues = (runner_queue_t*) calloc(runner_threads, sizeof(runner_queue_t));
+    threads = (pthread_t*) calloc(runner_threads, sizeof(pthread_t));
+    per_thread = (runner_job_count + runner_threads - 1) / runner_threads;
+    for (t = 0; t < runner_threads; t++) {
+        pthread_mutex_init(&runner_queues[t].lock, NULL);
+        runner_queues[t].head = t * per_thread < runner_job_count ? t * per_thread : runner_job_count;
+        runner_queues[t].tail = (t + 1) * per_thread < runner_job_count ? (t + 1) * per_thread : runner_job_count;
+    }
+
+    for (t = 0; t < runner_threads; t++) {
+        if (pthread_create(&threads[t], NULL, iplc_sim_runner_worker, (void*) (intptr_t) t) != 0) {
+            printf("pthread_create failed \n");
+            exit(-1);
+        }
+    }
+    for (t = 0; t < runner_threads; t++)
+        pthread_join(threads[t], NULL);
+
+    for (t = 0; t < runner_threads; t++)
+        pthread_mutex_destroy(&runner_queues[t].lock);
+    free(runner_queues);
+    free(threads);
+    if (!(trace->binary && trace->map))
+        free(runner_trace);
+}
+
+/*
+ * Print one row per configuration as CSV, or as a JSON array with -f json.
+ * branch_prediction is 0 or 1 for the static predictor, otherwise the name
+ * of the dynamic predictor every job used.
+ * Configurations too big for the host, or that the policy can not run,
+ * are left out.
+ */
+void iplc_sim_runner_report()
+{
+    int i, rows = 0, skipped = 0;
+
+    if (runner_json)
+        printf("[\n");
+    else
+        printf("index,blocksize,assoc,policy,branch_prediction,cache_size,cache_accesses,cache_hits,"
+               "cache_misses,evictions,miss_rate,cycles,instructions,branches,correct_branch_predictions,"
+               "mpki,cpi\n");
+
+    for (i = 0; i < runner_job_count; i++) {
+        runner_job_t *job = &runner_jobs[i];
+        double miss_rate = job->cache_access ? (double)job->cache_miss / (double)job->cache_access : 0.0;
+        double cpi = job->instruction_count ? (double)job->pipeline_cycles / (double)job->instruction_count : 0.0;
+        double mpki = job->instruction_count ? 1000.0 * (double)job->branch_mispredictions / (double)job->instruction_count : 0.0;
+        const char *branch_prediction = runner_template.predictor == PREDICT_STATIC ?
+            (job->branch_predict_taken ? "1" : "0") : predictor_names[runner_template.predictor];
+
+        if (job->status < 0) {
+            skipped++;
+            continue;
+        }
+
+        if (runner_json)
+            printf("%s  {\"index\": %d, \"blocksize\": %d, \"assoc\": %d, \"policy\": \"%s\", "
+                   "\"branch_prediction\": %s%s%s, \"cache_size\": %lu, \"cache_accesses\": %ld, "
+                   "\"cache_hits\": %ld, \"cache_misses\": %ld, \"evictions\": %ld, \"miss_rate\": %f, "
+                   "\"cycles\": %u, \"instructions\": %u, "
+                   "\"branches\": %u, \"correct_branch_predictions\": %u, \"mpki\": %f, \"cpi\": %f}",
+                   rows ? ",\n" : "", job->index, job->blocksize, job->assoc, policy_names[job->policy],
+                   runner_template.predictor ? "\"" : "", branch_prediction, runner_template.predictor ? "\"" : "",
+                   job->cache_size, job->cache_access, job->cache_hit,
+                   job->cache_miss, job->cache_evictions, miss_rate,
+                   job->pipeline_cycles, job->instruction_count, job->branch_count,
+                   job->correct_branch_predictions, mpki, cpi);
+        else
+            printf("%d,%d,%d,%s,%s,%lu,%ld,%ld,%ld,%ld,%f,%u,%u,%u,%u,%f,%f\n",
+                   job->index, job->blocksize, job->assoc, policy_names[job->policy],
+                   branch_prediction, job->cache_size, job->cache_access, job->cache_hit,
+                   job->cache_miss, job->cache_evictions, miss_rate,
+                   job->pipeline_cycles, job->instruction_count, job->branch_count,
+                   job->correct_branch_predictions, mpki, cpi);
+        rows++;
+    }
+
+    if (runner_json)
+        printf("%s]\n", rows ? "\n" : "");
+    if (skipped)
+        fprintf(stderr, "Skipped %d configurations too big or unfit for their policy \n", skipped);
+    free(runner_jobs);
+}
+
+/************************************************************************************************/
+/* Multi-core Functions *************************************************************************/
+/************************************************************************************************/
+
+/*
+ * Look up a coherence protocol by name, -1 if there is no such protocol.
+ */
+int iplc_sim_parse_protocol(char *name)
+{
+    int i;
+
+    for (i = 0; i < PROTOCOL_COUNT; i++) {
+        if (strcmp(name, protocol_names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/*
+ * The statistics of an L1 block number, added to the table if it is new.
+ * The caller holds the bus.
+ */
+block_stats_t *iplc_sim_block_stats(multicore_t *mc, uint block)
+{
+    uint i;
+
+    if (2 * (mc->block_count + 1) > (long) mc->block_mask + 1) {
+        block_stats_t *old = mc->blocks;
+        uint old_size = mc->block_mask + 1;
+
+        mc->block_mask = 2 * old_size - 1;
+        mc->block_shift--;
+        mc->blocks = (block_stats_t*) calloc(2 * old_size, sizeof(block_stats_t));
+        for (i = 0; i < old_size; i++) {
+            if (old[i].block) {
+                uint j = (old[i].block * 0x9e3779b9u) >> mc->block_shift;
+
+                while (mc->blocks[j].block)
+                    j = (j + 1) & mc->block_mask;
+                mc->blocks[j] = old[i];
+            }
+        }
+        free(old);
+    }
+
+    block++;
+    for (i = (block * 0x9e3779b9u) >> mc->block_shift; mc->blocks[i].block; i = (i + 1) & mc->block_mask) {
+        if (mc->blocks[i].block == block)
+            return &mc->blocks[i];
+    }
+    mc->blocks[i].block = block;
+    mc->block_count++;
+    return &mc->blocks[i];
+}
+
+/*
+ * The way of an L1D holding address, or -1, and the line's place in the
+ * per way arrays.
+ */
+static inline int iplc_sim_coherent_way(cache_t *cache, unsigned int address, size_t *line)
+{
+    uint tag = address >> (cache->blockoffsetbits + cache->index);
+    int index = (address >> cache->blockoffsetbits) & ((1 << cache->index) - 1);
+    int way = iplc_sim_cache_find(cache, index, tag);
+
+    *line = (size_t) index * cache->assoc + way;
+    return way;
+}
+
+/*
+ * The touched bit of the word at address within its block.
+ */
+static inline uint64_t iplc_sim_word_bit(cache_t *cache, unsigned int address)
+{
+    uint word = (address & ((1 << cache->blockoffsetbits) - 1)) >> 2;
+
+    return 1ULL << (word < 63 ? word : 63);
+}
+
+/*
+ * An L1 miss of a core served by the shared L2, or memory past it.
+ * Returns the latency.  The caller holds the bus.
+ */
+int iplc_sim_shared_walk(iplc_sim_t *sim, unsigned int address)
+{
+    multicore_t *mc = sim->multicore;
+
+    if (iplc_sim_cache_access(&mc->l2, address))
+        return mc->l2.latency;
+    if (mc->l2.evicted && mc->l2.evicted_dirty) {
+        mc->l2.writebacks++;
+        mc->memory_writes++;
     }
+    sim->memory_accesses++;
+    return sim->memory_latency;
 }
 
 /*
- * Don't touch this function.  It is for parsing the instruction stream.
+ * Write a dirty L1D block back into the shared L2.  The caller holds the
+ * bus.
  */
-void iplc_sim_parse_instruction(char *buffer)
+void iplc_sim_shared_write(multicore_t *mc, unsigned int address)
 {
-    int instruction_hit = 0;
-    int i=0, j=0;
-    int src_reg=0;
-    int src_reg2=0;
-    int dest_reg=0;
-    char str_src_reg[16];
-    char str_src_reg2[16];
-    char str_dest_reg[16];
-    char str_constant[16];
-    
-    if (sscanf(buffer, "%x %s", &instruction_address, instruction ) != 2) {
-        printf("Malformed instruction \n");
-        exit(-1);
+    cache_t *l2 = &mc->l2;
+
+    l2->writes++;
+    iplc_sim_cache_insert(l2, address);
+    if (l2->evicted && l2->evicted_dirty) {
+        l2->writebacks++;
+        mc->memory_writes++;
     }
-    
-    instruction_hit = iplc_sim_trap_address( instruction_address );
-    
-    // if a MISS, then push current instruction thru pipeline
-    if (!instruction_hit) {
-        // need to subtract 1, since the stage is pushed once more for actual instruction processing
-        // also need to allow for a branch miss prediction during the fetch cache miss time -- by
-        // counting cycles this allows for these cycles to overlap and not doubly count.
-        
-        printf("INST MISS:\t Address 0x%x \n", instruction_address);
-        
-        for (i = pipeline_cycles, j = pipeline_cycles; i < j + CACHE_MISS_DELAY - 1; i++)
-            iplc_sim_push_pipeline_stage();
+    iplc_sim_cache_mark_dirty(l2, address);
+}
+
+/*
+ * Show a bus transaction of core sim for the block at address to every
+ * other L1D.  A read (BusRd) leaves the other copies shared: under MESI a
+ * modified copy is written back to the L2 first, under MOESI it becomes
+ * owned and stays dirty.  A write (BusRdX or BusUpgr) invalidates them;
+ * an invalidated copy that never used the word being written is false
+ * sharing.  Returns whether another copy could supply the block (it was
+ * M, O or E), and sets shared if any copy is left.  The caller holds the
+ * bus.
+ */
+int iplc_sim_snoop(iplc_sim_t *sim, unsigned int address, int write, int *shared)
+{
+    multicore_t *mc = sim->multicore;
+    uint block = address >> sim->l1d->blockoffsetbits;
+    uint64_t word = iplc_sim_word_bit(sim->l1d, address);
+    int supplied = FALSE, c;
+    block_stats_t *stats;
+    size_t line;
+
+    *shared = FALSE;
+    for (c = 0; c < mc->cores; c++) {
+        iplc_sim_t *other = &mc->core[c];
+        cache_t *cache = other->l1d;
+        BYTE *state = cache->coherence;
+
+        if (other == sim)
+            continue;
+        pthread_mutex_lock(&mc->l1d_lock[c]);
+        if (iplc_sim_coherent_way(cache, address, &line) >= 0) {
+            supplied |= state[line] != STATE_S;
+            if (write) {
+                cache->valid[line / cache->assoc] &= ~(1ULL << (line % cache->assoc));
+                other->invalidations_received++;
+                sim->invalidations_sent++;
+                other->coherence_lost[block & ((1 << COHERENCE_LOST_BITS) - 1)] = block + 1;
+                stats = iplc_sim_block_stats(mc, block);
+                stats->invalidations++;
+                if (!(cache->touched[line] & word)) {
+                    other->false_sharing++;
+                    stats->false_sharing++;
+                }
+            }
+            else {
+                *shared = TRUE;
+                if (state[line] == STATE_M && mc->protocol == PROTOCOL_MESI) {
+                    other->coherence_writebacks++;
+                    iplc_sim_shared_write(mc, address);
+                    state[line] = STATE_S;
+                }
+                else if (state[line] == STATE_M) {
+                    state[line] = STATE_O;
+                }
+                else if (state[line] == STATE_E) {
+                    state[line] = STATE_S;
+                }
+            }
+        }
+        pthread_mutex_unlock(&mc->l1d_lock[c]);
+    }
+    return supplied;
+}
+
+/*
+ * A LW (or a SW, write set) of core sim reaching its L1D.  A load hit, or
+ * a store hit on an exclusive or modified copy, stays inside the core.
+ * Anything else is a bus transaction: the other L1Ds are snooped, then a
+ * miss is served by another core's copy at the L2 latency, or by the L2
+ * (or memory) itself, and an upgrade costs the L2 latency.  A modified or
+ * owned victim is written back to the L2.  Only other cores snooping
+ * touch this core's L1D and they hold the bus, so the bus covers all of
+ * the slow path.  Returns whether the L1D hit, cycles is set like
+ * iplc_sim_trap_address() does.
+ */
+int iplc_sim_coherent_access(iplc_sim_t *sim, unsigned int address, int write, int *cycles)
+{
+    multicore_t *mc = sim->multicore;
+    cache_t *cache = sim->l1d;
+    pthread_mutex_t *own = &mc->l1d_lock[sim->core_id];
+    uint block = address >> cache->blockoffsetbits;
+    uint *lost = &sim->coherence_lost[block & ((1 << COHERENCE_LOST_BITS) - 1)];
+    uint64_t word = iplc_sim_word_bit(cache, address);
+    int state, hit, shared, supplied;
+    size_t line;
+
+    pthread_mutex_lock(own);
+    state = iplc_sim_coherent_way(cache, address, &line) >= 0 ? cache->coherence[line] : STATE_I;
+    if (state != STATE_I && (!write || state == STATE_E || state == STATE_M)) {
+        hit = iplc_sim_cache_access(cache, address);
+        if (write)
+            cache->coherence[line] = STATE_M;
+        cache->touched[line] |= word;
+        pthread_mutex_unlock(own);
+        *cycles = cache->latency;
+        cache->access_cycles += *cycles;
+        return hit;
     }
+    pthread_mutex_unlock(own);
+
+    pthread_mutex_lock(&mc->bus);
+    // another core may have taken the copy since
+    state = iplc_sim_coherent_way(cache, address, &line) >= 0 ? cache->coherence[line] : STATE_I;
+    if (!write)
+        sim->bus_reads++;
+    else if (state == STATE_I)
+        sim->bus_read_exclusives++;
     else
-        printf("INST HIT:\t Address 0x%x \n", instruction_address);
-    
-    // Parse the Instruction
-    
-    if (strncmp( instruction, "add", 3 ) == 0 ||
-        strncmp( instruction, "sll", 3 ) == 0 ||
-        strncmp( instruction, "ori", 3 ) == 0) {
-        if (sscanf(buffer, "%x %s %s %s %s",
-                   &instruction_address,
-                   instruction,
-                   str_dest_reg,
-                   str_src_reg,
-                   str_src_reg2 ) != 5) {
-            printf("Malformed RTYPE instruction (%s) at address 0x%x \n",
-                   instruction, instruction_address);
-            exit(-1);
+        sim->bus_upgrades++;
+    supplied = iplc_sim_snoop(sim, address, write, &shared);
+
+    if (state == STATE_I && *lost == block + 1) {
+        sim->coherence_misses++;
+        iplc_sim_block_stats(mc, block)->coherence_misses++;
+        *lost = 0;
+    }
+
+    hit = iplc_sim_cache_access(cache, address);
+    if (hit) {
+        *cycles = mc->l2.latency;
+    }
+    else {
+        if (supplied) {
+            sim->cache_transfers++;
+            *cycles = mc->l2.latency;
         }
-        
-        dest_reg = iplc_sim_parse_reg(str_dest_reg);
-        src_reg = iplc_sim_parse_reg(str_src_reg);
-        src_reg2 = iplc_sim_parse_reg(str_src_reg2);
-        
-        iplc_sim_process_pipeline_rtype(instruction, dest_reg, src_reg, src_reg2);
+        else {
+            *cycles = iplc_sim_shared_walk(sim, address);
+        }
+        // the victim's state is still in the way the block went to
+        iplc_sim_coherent_way(cache, address, &line);
+        if (cache->evicted && (cache->coherence[line] == STATE_M || cache->coherence[line] == STATE_O)) {
+            cache->writebacks++;
+            iplc_sim_shared_write(mc, cache->evicted_address);
+        }
+        cache->touched[line] = 0;
     }
-    
-    else if (strncmp( instruction, "lui", 3 ) == 0) {
-        if (sscanf(buffer, "%x %s %s %s",
-                   &instruction_address,
-                   instruction,
-                   str_dest_reg,
-                   str_constant ) != 4 ) {
-            printf("Malformed RTYPE instruction (%s) at address 0x%x \n",
-                   instruction, instruction_address );
-            exit(-1);
+    cache->coherence[line] = write ? STATE_M : shared ? STATE_S : STATE_E;
+    cache->touched[line] |= word;
+    pthread_mutex_unlock(&mc->bus);
+
+    cache->access_cycles += *cycles;
+    return hit;
+}
+
+/*
+ * Start the next quantum.  The caller holds sync.
+ */
+static void iplc_sim_multicore_advance(multicore_t *mc)
+{
+    mc->waiting = 0;
+    mc->epoch_end += mc->quantum;
+    mc->generation++;
+    pthread_cond_broadcast(&mc->advance);
+}
+
+/*
+ * Wait until every core still running has reached the end of this
+ * quantum, the last one to get there starts the next.  epoch_end is set
+ * to its end.
+ */
+void iplc_sim_multicore_sync(multicore_t *mc, unsigned int *epoch_end)
+{
+    long generation;
+
+    pthread_mutex_lock(&mc->sync);
+    if (++mc->waiting == mc->active) {
+        iplc_sim_multicore_advance(mc);
+    }
+    else {
+        generation = mc->generation;
+        while (generation == mc->generation)
+            pthread_cond_wait(&mc->advance, &mc->sync);
+    }
+    *epoch_end = mc->epoch_end;
+    pthread_mutex_unlock(&mc->sync);
+}
+
+/*
+ * Host thread of one core: run its trace through its pipeline, meeting
+ * the others at the end of every quantum, then drain the pipeline.
+ */
+void *iplc_sim_core_run(void *arg)
+{
+    iplc_sim_t *sim = (iplc_sim_t*) arg;
+    multicore_t *mc = sim->multicore;
+    unsigned int epoch_end = mc->quantum;
+    iplc_inst_t inst;
+
+    while (iplc_sim_trace_next(mc->trace[sim->core_id], &inst)) {
+        iplc_sim_process_instruction(sim, &inst);
+        while (sim->pipeline_cycles >= epoch_end)
+            iplc_sim_multicore_sync(mc, &epoch_end);
+    }
+    iplc_sim_drain(sim);
+
+    // the others no longer wait for this core
+    pthread_mutex_lock(&mc->sync);
+    mc->active--;
+    if (mc->waiting && mc->waiting == mc->active)
+        iplc_sim_multicore_advance(mc);
+    pthread_mutex_unlock(&mc->sync);
+    return NULL;
+}
+
+/*
+ * Order blocks by false sharing, then by invalidations.
+ */
+int iplc_sim_block_compare(const void *a, const void *b)
+{
+    const block_stats_t *x = (const block_stats_t*) a, *y = (const block_stats_t*) b;
+
+    if (x->false_sharing != y->false_sharing)
+        return x->false_sharing < y->false_sharing ? 1 : -1;
+    if (x->invalidations != y->invalidations)
+        return x->invalidations < y->invalidations ? 1 : -1;
+    return x->block < y->block ? -1 : x->block > y->block;
+}
+
+/*
+ * The bus traffic of every core, and the blocks with the most false
+ * sharing.
+ */
+void iplc_sim_coherence_report(multicore_t *mc)
+{
+    block_stats_t *top = (block_stats_t*) malloc((mc->block_count + 1) * sizeof(block_stats_t));
+    int bits = mc->core[0].l1d->blockoffsetbits;
+    long count = 0, i;
+    int c;
+
+    printf("Coherence, %s protocol \n", protocol_names[mc->protocol]);
+    for (c = 0; c < mc->cores; c++) {
+        iplc_sim_t *sim = &mc->core[c];
+
+        printf("\t Core %d Number of Bus Reads is %ld \n", c, sim->bus_reads);
+        printf("\t Core %d Number of Bus Read Exclusives is %ld \n", c, sim->bus_read_exclusives);
+        printf("\t Core %d Number of Bus Upgrades is %ld \n", c, sim->bus_upgrades);
+        printf("\t Core %d Number of Cache to Cache Transfers is %ld \n", c, sim->cache_transfers);
+        printf("\t Core %d Number of Invalidations Sent is %ld \n", c, sim->invalidations_sent);
+        printf("\t Core %d Number of Invalidations Received is %ld \n", c, sim->invalidations_received);
+        printf("\t Core %d Number of False Sharing Invalidations is %ld \n", c, sim->false_sharing);
+        printf("\t Core %d Number of Coherence Misses is %ld \n", c, sim->coherence_misses);
+        printf("\t Core %d Number of Coherence Writebacks is %ld \n", c, sim->coherence_writebacks);
+        printf("\t Core %d Number of Dirty Victim Writebacks is %ld \n", c, sim->l1d->writebacks);
+    }
+    printf("\n");
+
+    for (i = 0; i <= (long) mc->block_mask; i++) {
+        if (mc->blocks[i].block && mc->blocks[i].invalidations)
+            top[count++] = mc->blocks[i];
+    }
+    qsort(top, count, sizeof(block_stats_t), iplc_sim_block_compare);
+    printf("False Sharing Hotspots \n");
+    for (i = 0; i < count && i < COHERENCE_TOP; i++) {
+        printf("\t Block 0x%x: %ld Invalidations, %ld False Sharing, %ld Coherence Misses \n",
+               (top[i].block - 1) << bits, top[i].invalidations, top[i].false_sharing,
+               top[i].coherence_misses);
+    }
+    if (count == 0)
+        printf("\t No block was invalidated \n");
+    printf("\n");
+    free(top);
+}
+
+/*
+ * Run one trace per core, first is the already open trace of core 0.
+ * Every core is set up like template, with a split L1 of the given
+ * geometry and template's L2 (-2) shared between all of them.  Reports
+ * every core, then the L2, memory and the coherence traffic.  Returns -1
+ * if the configuration can not be built.
+ */
+int iplc_sim_multicore_run(iplc_sim_t *template, int protocol, unsigned int quantum, trace_t *first,
+                           char **trace_names, int cores, int index, int blocksize, int assoc)
+{
+    multicore_t *mc = (multicore_t*) calloc(1, sizeof(multicore_t));
+    pthread_t threads[MAX_CORES];
+    int verbose = template->verbose, c, status = 0;
+    long memory_accesses = 0;
+    size_t lines;
+
+    mc->protocol = protocol;
+    mc->cores = cores;
+    mc->quantum = mc->epoch_end = quantum;
+    mc->active = cores;
+    mc->trace = (trace_t**) calloc(cores, sizeof(trace_t*));
+    mc->trace_names = trace_names;
+    mc->core = (iplc_sim_t*) calloc(cores, sizeof(iplc_sim_t));
+    mc->block_mask = (1 << COHERENCE_BLOCK_BITS) - 1;
+    mc->block_shift = 32 - COHERENCE_BLOCK_BITS;
+    mc->blocks = (block_stats_t*) calloc(mc->block_mask + 1, sizeof(block_stats_t));
+    pthread_mutex_init(&mc->bus, NULL);
+    pthread_mutex_init(&mc->sync, NULL);
+    pthread_cond_init(&mc->advance, NULL);
+    for (c = 0; c < cores; c++)
+        pthread_mutex_init(&mc->l1d_lock[c], NULL);
+
+    if (verbose >= VERBOSE_CONFIG) {
+        printf("Multi-core \n");
+        printf("   Cores: %d \n", cores);
+        printf("   Protocol: %s \n", protocol_names[protocol]);
+        printf("   Quantum: %u \n", quantum);
+    }
+    if (iplc_sim_cache_init(&mc->l2, "L2", template->lower[0].index, template->lower[0].blocksize,
+                            template->lower[0].assoc, template->cache_policy, template->lower[0].latency, TRUE,
+                            verbose >= VERBOSE_CONFIG) < 0)
+        status = -1;
+
+    for (c = 0; c < cores && status == 0; c++) {
+        iplc_sim_t *sim = &mc->core[c];
+
+        *sim = *template;
+        sim->split_l1 = TRUE;
+        sim->lower_levels = 0;
+        sim->multicore = mc;
+        sim->core_id = c;
+        // every core has the same L1s, only the first prints them
+        sim->verbose = c ? VERBOSE_QUIET : verbose;
+        if (iplc_sim_init(sim, index, blocksize, assoc) < 0) {
+            status = -1;
+            break;
         }
-        
-        dest_reg = iplc_sim_parse_reg(str_dest_reg);
-        src_reg = -1;
-        src_reg2 = -1;
-        iplc_sim_process_pipeline_rtype(instruction, dest_reg, src_reg, src_reg2);
-    }
-    
-    else if (strncmp( instruction, "lw", 2 ) == 0 ||
-             strncmp( instruction, "sw", 2 ) == 0  ) {
-        if ( sscanf( buffer, "%x %s %s %s %x",
-                    &instruction_address,
-                    instruction,
-                    reg1,
-                    offsetwithreg,
-                    &data_address ) != 5) {
-            printf("Bad instruction: %s at address %x \n", instruction, instruction_address);
-            exit(-1);
+        if (mc->l2.blocksize < sim->l1d->blocksize) {
+            if (verbose >= VERBOSE_CONFIG)
+                printf("L2 BlockSize must be at least the level above it .... \n");
+            status = -1;
+            break;
         }
-        
-        if (strncmp(instruction, "lw", 2 ) == 0) {
-            
-            dest_reg = iplc_sim_parse_reg(reg1);
-            
-            // don't need to worry about base regs -- just insert -1 values
-            iplc_sim_process_pipeline_lw(dest_reg, -1, data_address);
+        // the cores run at once, so nothing is printed per access
+        sim->verbose = verbose < VERBOSE_CONFIG ? verbose : VERBOSE_CONFIG;
+        sim->dump_pipeline = sim->debug = FALSE;
+        lines = (size_t) (1 << sim->l1d->index) * sim->l1d->assoc;
+        sim->l1d->coherence = (BYTE*) calloc(lines, sizeof(BYTE));
+        sim->l1d->touched = (uint64_t*) calloc(lines, sizeof(uint64_t));
+        sim->coherence_lost = (uint*) calloc(1 << COHERENCE_LOST_BITS, sizeof(uint));
+        if (c) {
+            mc->trace[c] = (trace_t*) malloc(sizeof(trace_t));
+            iplc_sim_trace_open(mc->trace[c], trace_names[c]);
         }
-        if (strncmp( instruction, "sw", 2 ) == 0) {
-            src_reg = iplc_sim_parse_reg(reg1);
-            
-            // don't need to worry about base regs -- just insert -1 values
-            iplc_sim_process_pipeline_sw( src_reg, -1, data_address);
+        else {
+            mc->trace[c] = first;
         }
     }
-    else if (strncmp( instruction, "beq", 3 ) == 0) {
-        // don't need to worry about getting regs -- just insert -1 values
-        iplc_sim_process_pipeline_branch(-1, -1);
+
+    if (status == 0) {
+        iplc_sim_opcode_keys_init();
+        for (c = 0; c < cores; c++) {
+            if (pthread_create(&threads[c], NULL, iplc_sim_core_run, &mc->core[c]) != 0) {
+                printf("pthread_create failed \n");
+                exit(-1);
+            }
+        }
+        for (c = 0; c < cores; c++)
+            pthread_join(threads[c], NULL);
+
+        for (c = 0; c < cores; c++) {
+            printf("Core %d, %s \n", c, trace_names[c]);
+            iplc_sim_finalize(&mc->core[c]);
+            memory_accesses += mc->core[c].memory_accesses;
+        }
+        iplc_sim_cache_report(&mc->core[0], &mc->l2);
+        printf(" Memory \n\t Number of Memory Accesses is %ld \n", memory_accesses);
+        printf("\t Number of Memory Writes is %ld \n\n", mc->memory_writes);
+        iplc_sim_coherence_report(mc);
     }
-    else if (strncmp( instruction, "jal", 3 ) == 0 ||
-             strncmp( instruction, "jr", 2 ) == 0 ||
-             strncmp( instruction, "j", 1 ) == 0 ) {
-        iplc_sim_process_pipeline_jump( instruction );
+
+    for (c = 0; c < cores; c++) {
+        iplc_sim_free(&mc->core[c]);
+        if (c && mc->trace[c]) {
+            iplc_sim_trace_close(mc->trace[c]);
+            free(mc->trace[c]);
+        }
+        pthread_mutex_destroy(&mc->l1d_lock[c]);
     }
-    else if (strncmp( instruction, "jal", 3 ) == 0 ||
-             strncmp( instruction, "jr", 2 ) == 0 ||
-             strncmp( instruction, "j", 1 ) == 0 ) {
-        /*
-         * Note: no need to worry about forwarding on the jump register
-         * we'll let that one go.
-         */
-        iplc_sim_process_pipeline_jump(instruction);
+    iplc_sim_cache_free(&mc->l2);
+    pthread_mutex_destroy(&mc->bus);
+    pthread_mutex_destroy(&mc->sync);
+    pthread_cond_destroy(&mc->advance);
+    free(mc->blocks);
+    free(mc->core);
+    free(mc->trace);
+    free(mc);
+    return status;
+}
+
+/************************************************************************************************/
+/* Benchmark Functions **************************************************************************/
+/************************************************************************************************/
+
+double iplc_sim_bench_now()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/*
+ * Time the simulator over every generated pattern, at the BENCH_
+ * configuration plus whatever hierarchy, policy and predictor options
+ * template carries.  Each pattern is generated into memory in the binary
+ * format first, so only decoding and simulation are timed.  The results
+ * are compared against baseline_name, or written to it if it doesn't
+ * exist yet.  Returns the number of patterns that got slower than the
+ * baseline by more than BENCH_TOLERANCE.
+ */
+int iplc_sim_bench_run(iplc_sim_t *template, char *baseline_name)
+{
+    double baseline[PATTERN_COUNT];
+    double ns[PATTERN_COUNT];
+    double start, elapsed, best, value;
+    int have_baseline = FALSE, regressions = 0;
+    int pattern, run;
+    char name[32];
+    BYTE *data;
+    size_t size, len;
+    unsigned int last_address, last_data_address;
+    generator_t gen;
+    iplc_inst_t inst;
+    iplc_sim_t sim;
+    trace_t trace;
+    struct rusage usage;
+    FILE *file;
+
+    for (pattern = 0; pattern < PATTERN_COUNT; pattern++)
+        baseline[pattern] = 0.0;
+    if ((file = fopen(baseline_name, "r")) != NULL) {
+        while (fscanf(file, "%31s %lf", name, &value) == 2) {
+            if ((pattern = iplc_sim_parse_pattern(name)) >= 0) {
+                baseline[pattern] = value;
+                have_baseline = TRUE;
+            }
+        }
+        fclose(file);
     }
-    else if ( strncmp( instruction, "syscall", 7 ) == 0) {
-        iplc_sim_process_pipeline_syscall( );
+
+    printf("Benchmark: index %d, blocksize %d, assoc %d, best of %d runs of %d instructions \n",
+           BENCH_INDEX, BENCH_BLOCKSIZE, BENCH_ASSOC, BENCH_REPEATS, BENCH_COUNT);
+    printf("%-12s %12s %10s %12s %12s %8s \n", "pattern", "instr/s", "ns/instr", "peak_rss_kb",
+           "baseline_ns", "change");
+
+    for (pattern = 0; pattern < PATTERN_COUNT; pattern++) {
+        size = TRACE_BUFFER_SIZE;
+        len = 0;
+        last_address = last_data_address = 0;
+        data = (BYTE*) malloc(size);
+        iplc_sim_generate_init(&gen, pattern, BENCH_COUNT, 0, 0);
+        while (iplc_sim_generate_next(&gen, &inst)) {
+            if (size - len < TRACE_RECORD_MAX) {
+                size *= 2;
+                data = (BYTE*) realloc(data, size);
+            }
+            len = iplc_sim_trace_encode(&inst, data + len, &last_address, &last_data_address) - data;
+        }
+        iplc_sim_generate_free(&gen);
+
+        best = 0.0;
+        for (run = 0; run < BENCH_REPEATS; run++) {
+            sim = *template;
+            if (iplc_sim_init(&sim, BENCH_INDEX, BENCH_BLOCKSIZE, BENCH_ASSOC) < 0) {
+                printf("Bad benchmark configuration, run with -v 1 or more for details \n");
+                exit(-1);
+            }
+            start = iplc_sim_bench_now();
+            iplc_sim_trace_memory(&trace, data, len, TRACE_VERSION);
+            while (iplc_sim_trace_next(&trace, &inst))
+                iplc_sim_process_instruction(&sim, &inst);
+            iplc_sim_drain(&sim);
+            elapsed = iplc_sim_bench_now() - start;
+            iplc_sim_free(&sim);
+            if (run == 0 || elapsed < best)
+                best = elapsed;
+        }
+        free(data);
+
+        ns[pattern] = best * 1e9 / BENCH_COUNT;
+        getrusage(RUSAGE_SELF, &usage);
+        printf("%-12s %12.0f %10.2f %12ld ", pattern_names[pattern], BENCH_COUNT / best, ns[pattern],
+               usage.ru_maxrss);
+        if (baseline[pattern] > 0.0) {
+            value = ns[pattern] / baseline[pattern] - 1.0;
+            printf("%12.2f %+7.1f%%%s \n", baseline[pattern], 100.0 * value,
+                   value > BENCH_TOLERANCE ? " SLOWER" : "");
+            regressions += value > BENCH_TOLERANCE;
+        }
+        else {
+            printf("%12s %8s \n", "-", "-");
+        }
     }
-    else if ( strncmp( instruction, "nop", 3 ) == 0) {
-        iplc_sim_process_pipeline_nop( );
+
+    if (!have_baseline) {
+        if ((file = fopen(baseline_name, "w")) == NULL) {
+            printf("fopen failed for %s file\n", baseline_name);
+            exit(-1);
+        }
+        for (pattern = 0; pattern < PATTERN_COUNT; pattern++)
+            fprintf(file, "%s %.3f\n", pattern_names[pattern], ns[pattern]);
+        fclose(file);
+        printf("Wrote baseline %s \n", baseline_name);
     }
-    else {
-        printf("Do not know how to process instruction: %s at address %x \n",
-               instruction, instruction_address );
-        exit(-1);
+    else if (regressions) {
+        printf("%d of %d patterns are more than %.0f%% slower than %s \n", regressions, PATTERN_COUNT,
+               100.0 * BENCH_TOLERANCE, baseline_name);
     }
+    return regressions;
 }
 
 /************************************************************************************************/
 /* MAIN Function ********************************************************************************/
 /************************************************************************************************/
 
-int main()
+int main(int argc, char *argv[])
 {
     char trace_file_name[1024];
-    FILE *trace_file = NULL;
-    char buffer[80];
+    char *convert_file_name = NULL;
+    char *event_file_name = NULL;
+    char *generate_spec = NULL;
+    char *bench_file_name = NULL;
+    char *profile_file_name = NULL;
+    char *save_file_name = NULL;
+    char *restore_file_name = NULL;
+    unsigned long save_at = 0;
+    unsigned long records = 0;
+    int profile_top = 0;
+    int verbosity = VERBOSE_PIPELINE;
+    trace_t trace;
+    iplc_inst_t inst;
+    iplc_sim_t sim;
     int index = 10;
     int blocksize = 1;
     int assoc = 1;
+    int sweep = FALSE;
+    int runner = FALSE;
+    int report_policy = FALSE;
+    int level = 0;
+    int protocol = -1;
+    unsigned int quantum = COHERENCE_QUANTUM;
+    int opt;
+    
+    bzero(&sim, sizeof(iplc_sim_t));
+    
+    while ((opt = getopt(argc, argv, "c:sSx:b:a:B:p:j:f:i2:3:l:m:e:P:t:g:k:v:E:D:n:o:F:G:T:Cw:W:r:M:H:N:u:A:K:R:L:Y:")) != -1) {
+        switch (opt) {
+            case 'c':
+                convert_file_name = optarg;
+                break;
+            case 's':
+                sweep = TRUE;
+                break;
+            case 'S':
+                runner = TRUE;
+                break;
+            case 'x':
+                sweep_index_count = iplc_sim_sweep_parse_list(optarg, sweep_index);
+                break;
+            case 'b':
+                sweep_blocksize_count = iplc_sim_sweep_parse_list(optarg, sweep_blocksize);
+                break;
+            case 'a':
+                sweep_assoc_count = iplc_sim_sweep_parse_list(optarg, sweep_assoc);
+                break;
+            case 'B':
+                sweep_branch_count = iplc_sim_sweep_parse_list(optarg, sweep_branch);
+                break;
+            case 'p':
+                sweep_policy_count = iplc_sim_sweep_parse_policies(optarg, sweep_policy);
+                report_policy = TRUE;
+                break;
+            case 'i':
+                sim.split_l1 = TRUE;
+                break;
+            case '2':
+            case '3':
+                level = opt - '2';
+                if (sscanf(optarg, "%d,%d,%d,%d", &sim.lower[level].index, &sim.lower[level].blocksize,
+                           &sim.lower[level].assoc, &sim.lower[level].latency) != 4) {
+                    printf("Bad L%c configuration, expected index,blocksize,assoc,latency: %s \n", opt, optarg);
+                    exit(-1);
+                }
+                if (level + 1 > sim.lower_levels)
+                    sim.lower_levels = level + 1;
+                break;
+            case 'l':
+                sim.l1_latency = atoi(optarg);
+                break;
+            case 'm':
+                sim.memory_latency = atoi(optarg);
+                break;
+            case 'e':
+                for (sim.inclusion = 0; sim.inclusion < INCLUSION_COUNT; sim.inclusion++) {
+                    if (strcmp(optarg, inclusion_names[sim.inclusion]) == 0)
+                        break;
+                }
+                if (sim.inclusion == INCLUSION_COUNT) {
+                    printf("Unknown inclusion: %s \n", optarg);
+                    exit(-1);
+                }
+                break;
+            case 'P':
+                sim.predictor = iplc_sim_parse_predictor(optarg);
+                if (sim.predictor < 0) {
+                    printf("Unknown branch predictor: %s \n", optarg);
+                    exit(-1);
+                }
+                sim.report_predictor = TRUE;
+                break;
+            case 't':
+                sim.predictor_bits = atoi(optarg);
+                break;
+            case 'g':
+                sim.history_bits = atoi(optarg);
+                break;
+            case 'k':
+                sim.btb_bits = atoi(optarg);
+                break;
+            case 'v':
+                verbosity = atoi(optarg);
+                break;
+            case 'E':
+                event_file_name = optarg;
+                break;
+            case 'D':
+                iplc_sim_event_decode(optarg);
+                return 0;
+            case 'n':
+                sim.interval = atoi(optarg);
+                break;
+            case 'o':
+                if ((sim.interval_file = fopen(optarg, "w")) == NULL) {
+                    printf("fopen failed for %s file\n", optarg);
+                    exit(-1);
+                }
+                break;
+            case 'F':
+                if (sscanf(optarg, "%u,%u,%u", &sim.sample_ff, &sim.sample_warmup, &sim.sample_detail) != 3 ||
+                    sim.sample_detail == 0) {
+                    printf("Bad sampling, expected fast_forward,warmup,detailed with detailed > 0: %s \n", optarg);
+                    exit(-1);
+                }
+                break;
+            case 'C':
+                sim.classify_misses = TRUE;
+                break;
+            case 'w':
+                sim.write_model = TRUE;
+                if (strncmp(optarg, "through", 7) == 0)
+                    sim.write_through = sim.write_no_allocate = TRUE;
+                else if (strncmp(optarg, "back", 4) != 0) {
+                    printf("Bad write policy, expected back|through[,allocate|noallocate]: %s \n", optarg);
+                    exit(-1);
+                }
+                if (strstr(optarg, ",allocate"))
+                    sim.write_no_allocate = FALSE;
+                else if (strstr(optarg, ",noallocate"))
+                    sim.write_no_allocate = TRUE;
+                break;
+            case 'W':
+                sim.write_model = TRUE;
+                sim.write_buffer_size = atoi(optarg);
+                if (sim.write_buffer_size < 0) {
+                    printf("Bad write buffer size: %s \n", optarg);
+                    exit(-1);
+                }
+                break;
+            case 'r': {
+                char *comma = strchr(optarg, ',');
+
+                if (comma)
+                    *comma = '\0';
+                sim.prefetcher = iplc_sim_parse_prefetcher(optarg);
+                if (sim.prefetcher < 0 ||
+                    (comma && sscanf(comma + 1, "%d,%d", &sim.prefetch_degree, &sim.prefetch_latency) < 1) ||
+                    sim.prefetch_degree < 0 || sim.prefetch_degree > PREFETCH_DEGREE_MAX ||
+                    sim.prefetch_latency < 0) {
+                    printf("Bad prefetcher, expected nextline|stride|stream[,degree[,latency]] "
+                           "with degree up to %d: %s \n", PREFETCH_DEGREE_MAX, optarg);
+                    exit(-1);
+                }
+                break;
+            }
+            case 'M':
+                sim.mshrs = atoi(optarg);
+                if (sim.mshrs < 0) {
+                    printf("Bad MSHR count: %s \n", optarg);
+                    exit(-1);
+                }
+                break;
+            case 'H':
+                for (sim.forwarding = 0; sim.forwarding < FORWARD_COUNT; sim.forwarding++) {
+                    if (strcmp(optarg, forwarding_names[sim.forwarding]) == 0)
+                        break;
+                }
+                if (sim.forwarding == FORWARD_COUNT) {
+                    printf("Unknown forwarding: %s \n", optarg);
+                    exit(-1);
+                }
+                sim.scoreboard = TRUE;
+                break;
+            case 'N':
+                sim.pipeline_depth = MAX_STAGES;
+                sim.memory_ports = 1;
+                sim.alus = 0;
+                if (sscanf(optarg, "%d,%d,%d,%d", &sim.issue_width, &sim.pipeline_depth,
+                           &sim.memory_ports, &sim.alus) < 1 ||
+                    sim.issue_width < 1 || sim.issue_width > MAX_WIDTH ||
+                    sim.pipeline_depth < MAX_STAGES || sim.pipeline_depth > MAX_DEPTH ||
+                    sim.memory_ports < 1 || sim.memory_ports > sim.issue_width ||
+                    sim.alus < 0 || sim.alus > sim.issue_width) {
+                    printf("Bad superscalar pipeline, expected width[,depth[,memory_ports[,alus]]] "
+                           "with width 1-%d and depth %d-%d: %s \n", MAX_WIDTH, MAX_STAGES, MAX_DEPTH, optarg);
+                    exit(-1);
+                }
+                if (sim.alus == 0)
+                    sim.alus = sim.issue_width;
+                // the groups always go through the scoreboard, -H only changes its forwarding
+                sim.scoreboard = TRUE;
+                break;
+            case 'u': {
+                char *comma = strchr(optarg, ',');
+
+                if (comma)
+                    *comma = '\0';
+                protocol = iplc_sim_parse_protocol(optarg);
+                if (protocol < 0 || (comma && (sscanf(comma + 1, "%u", &quantum) != 1 || quantum == 0))) {
+                    printf("Bad coherence, expected mesi|moesi[,quantum] with quantum > 0: %s \n", optarg);
+                    exit(-1);
+                }
+                break;
+            }
+            case 'A': {
+                char *comma = strchr(optarg, ',');
+
+                if (comma)
+                    *comma = '\0';
+                profile_top = atoi(optarg);
+                profile_file_name = comma ? comma + 1 : NULL;
+                if (profile_top < 1 || (comma && *profile_file_name == '\0')) {
+                    printf("Bad profile, expected top_n[,profile_file] with top_n > 0: %s \n", optarg);
+                    exit(-1);
+                }
+                break;
+            }
+            case 'K': {
+                char *comma = strrchr(optarg, ',');
+
+                if (comma == NULL || comma == optarg || sscanf(comma + 1, "%lu", &save_at) != 1 || save_at == 0) {
+                    printf("Bad checkpoint, expected checkpoint_file,instructions with instructions > 0: %s \n",
+                           optarg);
+                    exit(-1);
+                }
+                *comma = '\0';
+                save_file_name = optarg;
+                break;
+            }
+            case 'R':
+                restore_file_name = optarg;
+                break;
+            case 'L':
+                if (sscanf(optarg, "%d,%d,%d,%d,%d", &sim.tlb_entries, &sim.tlb_assoc, &sim.l2_tlb_entries,
+                           &sim.l2_tlb_assoc, &sim.l2_tlb_latency) < 2 ||
+                    sim.tlb_entries < 1 || sim.tlb_assoc < 1 || sim.tlb_assoc > MAX_ASSOC ||
+                    sim.l2_tlb_entries < 0 || (sim.l2_tlb_entries &&
+                    (sim.l2_tlb_assoc < 1 || sim.l2_tlb_assoc > MAX_ASSOC || sim.l2_tlb_latency < 0))) {
+                    printf("Bad TLBs, expected entries,assoc[,l2_entries,l2_assoc[,l2_latency]] "
+                           "with assoc 1-%d: %s \n", MAX_ASSOC, optarg);
+                    exit(-1);
+                }
+                break;
+            case 'Y': {
+                char *comma = strchr(optarg, ',');
+
+                if (comma)
+                    *comma = '\0';
+                sim.page_bits = strcmp(optarg, "4k") == 0 ? PAGE_4K_BITS :
+                                strcmp(optarg, "2m") == 0 ? PAGE_2M_BITS : 0;
+                if (comma && strcmp(comma + 1, "cache") == 0)
+                    sim.walk_through_cache = TRUE;
+                else if (comma && (sscanf(comma + 1, "%d", &sim.walk_latency) != 1 || sim.walk_latency < 1))
+                    sim.page_bits = 0;
+                if (sim.page_bits == 0) {
+                    printf("Bad pages, expected 4k|2m[,level_latency|cache] with level_latency > 0: %s \n",
+                           optarg);
+                    exit(-1);
+                }
+                break;
+            }
+            case 'G':
+                generate_spec = optarg;
+                break;
+            case 'T':
+                bench_file_name = optarg;
+                break;
+            case 'j':
+                runner_threads = atoi(optarg);
+                break;
+            case 'f':
+                runner_json = strcmp(optarg, "json") == 0;
+                break;
+            default:
+                printf("Usage: %s [-c binary_tracefile] [-s | -S [-B branch_list] [-j threads] [-f csv|json]]\n"
+                       "       [-x index_list] [-b blocksize_list] [-a assoc_list]\n"
+                       "       [-p lru|plru|srrip|brrip|fifo|random[,...]] [-i] [-l l1_latency]\n"
+                       "       [-2 index,blocksize,assoc,latency [-3 index,blocksize,assoc,latency]]\n"
+                       "       [-m memory_latency] [-e inclusive|exclusive|nine]\n"
+                       "       [-P static|bimodal|gshare|tournament] [-t table_bits] [-g history_bits]\n"
+                       "       [-k btb_bits] [-v 0-4] [-E event_log] [-n interval [-o interval_csv]]\n"
+                       "       [-F fast_forward,warmup,detailed] [-C]\n"
+                       "       [-w back|through[,allocate|noallocate]] [-W write_buffer_entries]\n"
+                       "       [-r nextline|stride|stream[,degree[,latency]]] [-M mshrs]\n"
+                       "       [-H full|ex|mem|none] [-N width[,depth[,memory_ports[,alus]]]]\n"
+                       "       [-A top_n[,profile_file]] [-K checkpoint_file,instructions] [-R checkpoint_file]\n"
+                       "       [-L entries,assoc[,l2_entries,l2_assoc[,l2_latency]] [-Y 4k|2m[,level_latency|cache]]]\n"
+                       "       [tracefile]\n"
+                       "       %s -u mesi|moesi[,quantum] -2 index,blocksize,assoc,latency [options] tracefile ...\n"
+                       "       %s -D event_log\n"
+                       "       %s -G sequential|stride|random|chase|loop|call[,count[,param[,seed]]] tracefile\n"
+                       "       %s [hierarchy and predictor options] -T baseline_file\n",
+                       argv[0], argv[0], argv[0], argv[0], argv[0]);
+                exit(-1);
+        }
+    }
+    
+    if (sim.lower_levels == 2 && sim.lower[0].assoc == 0) {
+        printf("An L3 (-3) needs an L2 (-2) \n");
+        exit(-1);
+    }
+    if (sim.page_bits && !sim.tlb_entries) {
+        printf("Pages (-Y) need TLBs (-L) \n");
+        exit(-1);
+    }
     
-    printf("Please enter the tracefile: ");
-    scanf("%s", trace_file_name);
+    if (bench_file_name) {
+        sim.cache_policy = sweep_policy[0];
+        return iplc_sim_bench_run(&sim, bench_file_name) ? 1 : 0;
+    }
     
-    trace_file = fopen(trace_file_name, "r");
+    if (optind < argc) {
+        strncpy(trace_file_name, argv[optind], sizeof(trace_file_name) - 1);
+        trace_file_name[sizeof(trace_file_name) - 1] = '\0';
+    }
+    else {
+        if (verbosity > VERBOSE_QUIET)
+            printf("Please enter the tracefile: ");
+        scanf("%s", trace_file_name);
+    }
     
-    if ( trace_file == NULL ) {
-        printf("fopen failed for %s file\n", trace_file_name);
+    if ((event_file_name || sim.interval || profile_top) && (sweep || runner)) {
+        printf("Event logs (-E), intervals (-n) and profiles (-A) can only be written by a single simulation \n");
+        exit(-1);
+    }
+    if ((save_file_name || restore_file_name) && (sweep || runner || protocol >= 0)) {
+        printf("Checkpoints (-K and -R) are only taken of a single core simulation \n");
         exit(-1);
     }
+    if (sim.classify_misses && (sweep || runner)) {
+        printf("Miss classification (-C) is only reported by a single simulation \n");
+        exit(-1);
+    }
+    if (protocol >= 0) {
+        if (optind >= argc || argc - optind > MAX_CORES) {
+            printf("A multi-core run (-u) takes one tracefile per core, 1 to %d of them \n", MAX_CORES);
+            exit(-1);
+        }
+        if (sweep || runner || convert_file_name || generate_spec) {
+            printf("A multi-core run (-u) is a single simulation \n");
+            exit(-1);
+        }
+        if (sim.lower_levels != 1) {
+            printf("A multi-core run (-u) needs the shared L2 (-2) and no L3 \n");
+            exit(-1);
+        }
+        // the coherence states are the only dirty bits, and every L1D fill has to snoop
+        if (sim.write_model || sim.prefetcher || sim.sample_detail || event_file_name || sim.interval ||
+            profile_top || sim.tlb_entries) {
+            printf("A multi-core run (-u) can not use -w, -W, -r, -F, -E, -n, -A or -L \n");
+            exit(-1);
+        }
+    }
+    
+    if (generate_spec) {
+        iplc_sim_generate_trace(generate_spec, trace_file_name);
+        return 0;
+    }
+    
+    iplc_sim_trace_open(&trace, trace_file_name);
+    
+    if (convert_file_name) {
+        iplc_sim_trace_convert(&trace, convert_file_name);
+        iplc_sim_trace_close(&trace);
+        return 0;
+    }
+    
+    if (sweep) {
+        if (sweep_policy_count != 1 || sweep_policy[0] != POLICY_LRU) {
+            printf("The single pass sweep only models LRU, use -S for other policies \n");
+            exit(-1);
+        }
+        if (sim.split_l1 || sim.lower_levels || sim.l1_latency > 1 || sim.write_model || sim.prefetcher || sim.mshrs ||
+            (sim.memory_latency && sim.memory_latency != CACHE_MISS_DELAY)) {
+            printf("The single pass sweep only models the single cache, use -S for a hierarchy \n");
+            exit(-1);
+        }
+        if (sim.sample_detail) {
+            printf("The single pass sweep can not sample, use -S \n");
+            exit(-1);
+        }
+        if (sim.issue_width) {
+            printf("The single pass sweep has no superscalar pipeline, use -S \n");
+            exit(-1);
+        }
+        if (sim.scoreboard) {
+            printf("The single pass sweep has no scoreboard, use -S \n");
+            exit(-1);
+        }
+        if (sim.tlb_entries) {
+            printf("The single pass sweep has no TLBs, use -S \n");
+            exit(-1);
+        }
+        iplc_sim_sweep_init();
+        iplc_sim_sweep_run(&trace);
+        iplc_sim_sweep_finalize();
+        iplc_sim_trace_close(&trace);
+        return 0;
+    }
+    
+    if (runner) {
+        // the -B list only means something to the static predictor
+        if (sim.predictor != PREDICT_STATIC)
+            sweep_branch_count = 1;
+        runner_template = sim;
+        iplc_sim_runner_run(&trace);
+        iplc_sim_runner_report();
+        iplc_sim_trace_close(&trace);
+        return 0;
+    }
     
-    printf("Enter Cache Size (index), Blocksize and Level of Assoc \n");
+    sim.verbose = verbosity;
+    sim.dump_pipeline = verbosity >= VERBOSE_PIPELINE;
+    sim.debug = verbosity >= VERBOSE_DEBUG;
+    sim.cache_policy = sweep_policy[0];
+    sim.report_policy = report_policy;
+    
+    if (verbosity > VERBOSE_QUIET)
+        printf("Enter Cache Size (index), Blocksize and Level of Assoc \n");
     scanf( "%d %d %d", &index, &blocksize, &assoc );
     
-    printf("Enter Branch Prediction: 0 (NOT taken), 1 (TAKEN): ");
-    scanf("%d", &branch_predict_taken );
+    if (verbosity > VERBOSE_QUIET)
+        printf("Enter Branch Prediction: 0 (NOT taken), 1 (TAKEN): ");
+    scanf("%d", &sim.branch_predict_taken );
+    
+    if (protocol >= 0) {
+        if (iplc_sim_multicore_run(&sim, protocol, quantum, &trace, &argv[optind], argc - optind,
+                                   index, blocksize, assoc) < 0) {
+            if (verbosity == VERBOSE_QUIET)
+                printf("Bad configuration, run with -v 1 or more for details \n");
+            exit(-1);
+        }
+        iplc_sim_trace_close(&trace);
+        return 0;
+    }
+    
+    if (iplc_sim_init(&sim, index, blocksize, assoc) < 0) {
+        if (verbosity == VERBOSE_QUIET)
+            printf("Bad configuration, run with -v 1 or more for details \n");
+        exit(-1);
+    }
     
-    iplc_sim_init(index, blocksize, assoc);
+    if (event_file_name)
+        sim.events = iplc_sim_event_open(event_file_name);
+    if (profile_top)
+        sim.profile = iplc_sim_profile_open(profile_top, profile_file_name, sim.l1d->blockoffsetbits);
+    if (restore_file_name)
+        records = iplc_sim_checkpoint_restore(&sim, restore_file_name, &trace);
+    if (save_at && records >= save_at) {
+        printf("The checkpoint to write (-K) is not after the restored one \n");
+        exit(-1);
+    }
     
-    while (fgets(buffer, 80, trace_file) != NULL) {
-        iplc_sim_parse_instruction(buffer);
-        if (dump_pipeline)
-            iplc_sim_dump_pipeline();
+    // a checkpoint ends the run, the report covers the instructions up to it
+    while (iplc_sim_trace_next(&trace, &inst)) {
+        iplc_sim_process_instruction(&sim, &inst);
+        if (sim.dump_pipeline)
+            iplc_sim_dump_pipeline(&sim);
+        if (++records == save_at) {
+            iplc_sim_checkpoint_save(&sim, save_file_name, &trace, records);
+            break;
+        }
     }
+    if (records < save_at)
+        printf("The trace ended after %lu instructions, no checkpoint was written \n", records);
     
-    iplc_sim_finalize();
+    iplc_sim_finalize(&sim);
+    if (sim.events)
+        iplc_sim_event_close(sim.events);
+    if (sim.profile)
+        iplc_sim_profile_close(sim.profile);
+    if (sim.interval_file && sim.interval_file != stdout)
+        fclose(sim.interval_file);
+    iplc_sim_free(&sim);
+    iplc_sim_trace_close(&trace);
     return 0;
 }
@@ -0,0 +1,98 @@
+#!/bin/sh
+#
+# Regression checks of the simulator against the traces in the repository.
+#
+#   tests/regress.sh [simulator]
+#
+# Without a simulator iplc-sim.c is built with cc into a scratch directory.
+# UPDATE=1 rewrites tests/expected from the simulator instead of checking.
+#
+# 1. The default interactive output, and the -v 0 summary, match the
+#    checked in expected output.
+# 2. Every row of the single pass sweep (-s) has the accesses and misses of
+#    a single run of that cache.
+# 3. A trace converted to the binary format (-c) replays exactly like the
+#    text trace, alone and under -s.
+# 4. A run checkpointed (-K) and restored (-R) part way reports exactly
+#    what the uninterrupted run does.
+
+cd "$(dirname "$0")/.." || exit 1
+scratch=$(mktemp -d)
+trap 'rm -rf "$scratch"' EXIT
+
+if [ -n "$1" ]; then
+    sim=$1
+else
+    sim=$scratch/iplc-sim
+    cc -O2 -o "$sim" iplc-sim.c -lm -lpthread || exit 1
+fi
+
+failures=0
+fail() {
+    echo "FAIL: $*"
+    failures=$((failures + 1))
+}
+
+# 1. default output: index blocksize assoc branch_prediction
+configs="7,1,1,0 5,2,2,1 4,1,4,0 3,2,8,1 6,1,2,0 2,4,3,1 0,1,16,0 5,4,1,1"
+mkdir -p tests/expected
+for config in $configs; do
+    set -- $(echo "$config" | tr ',' ' ')
+    expected=tests/expected/small_$1_$2_$3_$4.txt
+    printf 'instruction-trace-small.txt\n%s %s %s\n%s\n' "$1" "$2" "$3" "$4" | "$sim" > "$scratch/out"
+    if [ -n "$UPDATE" ]; then
+        cp "$scratch/out" "$expected"
+    elif ! cmp -s "$scratch/out" "$expected"; then
+        fail "default output of instruction-trace-small.txt $config"
+    fi
+
+    expected=tests/expected/summary_$1_$2_$3_$4.txt
+    printf '%s %s %s\n%s\n' "$1" "$2" "$3" "$4" | "$sim" -v 0 instruction-trace.txt > "$scratch/out"
+    if [ -n "$UPDATE" ]; then
+        cp "$scratch/out" "$expected"
+    elif ! cmp -s "$scratch/out" "$expected"; then
+        fail "summary of instruction-trace.txt $config"
+    fi
+done
+[ -n "$UPDATE" ] && echo "Updated tests/expected" && exit 0
+
+# 2. every -s row against a single run of its cache
+"$sim" -s instruction-trace.txt < /dev/null | tail -n +3 > "$scratch/sweep"
+rows=0
+while read -r index blocksize assoc size accesses hits misses rest; do
+    printf '%s %s %s\n0\n' "$index" "$blocksize" "$assoc" | "$sim" -v 0 instruction-trace.txt > "$scratch/out"
+    single=$(sed -n 's/.*Number of Cache Accesses is \([0-9]*\).*/\1/p; s/.*Number of Cache Misses is \([0-9]*\).*/\1/p' \
+             "$scratch/out" | tr '\n' ' ')
+    [ "$single" = "$accesses $misses " ] || fail "-s row $index $blocksize $assoc: $accesses $misses, single run $single"
+    rows=$((rows + 1))
+done < "$scratch/sweep"
+[ "$rows" -gt 0 ] || fail "-s wrote no rows"
+
+# 3. text and binary replay
+"$sim" -c "$scratch/trace.bin" instruction-trace.txt < /dev/null > /dev/null || fail "-c conversion"
+for config in $configs; do
+    set -- $(echo "$config" | tr ',' ' ')
+    printf '%s %s %s\n%s\n' "$1" "$2" "$3" "$4" | "$sim" -v 0 instruction-trace.txt > "$scratch/text"
+    printf '%s %s %s\n%s\n' "$1" "$2" "$3" "$4" | "$sim" -v 0 "$scratch/trace.bin" > "$scratch/binary"
+    cmp -s "$scratch/text" "$scratch/binary" || fail "binary replay $config"
+done
+"$sim" -s instruction-trace.txt < /dev/null > "$scratch/text"
+"$sim" -s "$scratch/trace.bin" < /dev/null > "$scratch/binary"
+cmp -s "$scratch/text" "$scratch/binary" || fail "binary replay under -s"
+
+# 4. checkpoint and restore against an uninterrupted run
+for options in "" "-i -2 8,4,4,10 -P gshare -k 6" "-w back -W 4 -r stride -M 4" "-H full -N 2" \
+               "-L 16,4,64,4 -Y 4k,cache -i"; do
+    for at in 1 10000 34752; do
+        printf '6 2 2\n0\n' | "$sim" -v 0 $options instruction-trace.txt > "$scratch/full"
+        printf '6 2 2\n0\n' | "$sim" -v 0 $options -K "$scratch/ckpt",$at instruction-trace.txt > /dev/null
+        printf '6 2 2\n0\n' | "$sim" -v 0 $options -R "$scratch/ckpt" instruction-trace.txt > "$scratch/restored"
+        cmp -s "$scratch/full" "$scratch/restored" || fail "restore after $at instructions with '$options'"
+    done
+done
+
+if [ "$failures" -gt 0 ]; then
+    echo "$failures regression checks failed"
+    exit 1
+fi
+echo "All regression checks passed ($rows sweep rows)"